@@ -2,6 +2,7 @@
 #include <linux/clk.h>
 #include <linux/device.h>
 #include <linux/hrtimer.h>
+#include <linux/idr.h>
 #include <linux/init.h>     /* Needed for the macros */
 #include <linux/interrupt.h>
 #include <linux/ioport.h>
@@ -216,14 +217,22 @@ struct dev_inst {
     unsigned long huge_npages;
     unsigned long huge_hnpages;
     struct page **huge_pages; /* theser are $KB pages use in 2MB pages */
+    struct mm_struct *huge_mm; /* address space the pages were pinned in */
+    struct file *huge_file;    /* file the pages were pinned through */
 
     bool desc_bypass_enabled;
     int open_count;
+
+    /* The /dev/xdma_control<n> and /dev/xdma_bypass<n> misc device nodes. */
+    struct miscdevice control_node;
+    struct miscdevice bypass_node;
+    char control_name[32];
+    char bypass_name[32];
 };
 
-/* The /dev/trace misc device node. */
-struct miscdevice misc_dev_node;
-struct miscdevice bypass_node;
+/* Indices of the probed cards, the first one keeps the unnumbered nodes.
+ * Indices are returned on remove, so a rebound card gets its old one. */
+static DEFINE_IDA(instance_ida);
 
 /*****************************/
 /* Utility functions         */
@@ -253,7 +262,6 @@ static int xdma_mmap(struct file *file, struct vm_area_struct *vma)
   int rc;
   //struct xdma_dev *lro;
   //struct xdma_char *lro_char = (struct xdma_char *)file->private_data;
-  struct device *parent;
   struct dev_inst *inst; //= (struct dev_inst *)file->private_data;
   resource_size_t phys, psize;
   unsigned long off;
@@ -264,10 +272,8 @@ static int xdma_mmap(struct file *file, struct vm_area_struct *vma)
   printk(KERN_INFO "xdma_mmap(%p ,%p)\n", file, vma);
   printk(KERN_INFO "MMAP %016lx-%016lx\n", vma->vm_start, vma->vm_end);
   
-  /* We set the parent to the trace device on creation. */
-  parent = misc_dev_node.parent;
-  printk(KERN_INFO "Parent device %p\n", parent);
-  inst = dev_get_drvdata(parent);
+  /* Set by xdma_open to the instance owning the node. */
+  inst = (struct dev_inst *)file->private_data;
   printk(KERN_INFO "Instance private data at %p\n", inst);
 
   BUG_ON(!inst);
@@ -317,7 +323,6 @@ static int xdma_bypass_mmap(struct file *file, struct vm_area_struct *vma)
   int rc;
   //struct xdma_dev *lro;
   //struct xdma_char *lro_char = (struct xdma_char *)file->private_data;
-  struct device *parent;
   struct dev_inst *inst; //= (struct dev_inst *)file->private_data;
   resource_size_t phys, psize;
   unsigned long off;
@@ -328,10 +333,8 @@ static int xdma_bypass_mmap(struct file *file, struct vm_area_struct *vma)
   printk(KERN_INFO "xdma_mmap(%p ,%p)\n", file, vma);
   printk(KERN_INFO "MMAP %016lx-%016lx\n", vma->vm_start, vma->vm_end);
   
-  /* We set the parent to the trace device on creation. */
-  parent = bypass_node.parent;
-  printk(KERN_INFO "Parent device %p\n", parent);
-  inst = dev_get_drvdata(parent);
+  /* Set by xdma_open to the instance owning the node. */
+  inst = (struct dev_inst *)file->private_data;
   printk(KERN_INFO "Instance private data at %p\n", inst);
 
   BUG_ON(!inst);
@@ -349,20 +352,32 @@ static int xdma_bypass_mmap(struct file *file, struct vm_area_struct *vma)
   psize =   pci_resource_len(inst->pci_dev, inst->bypass_bar_idx);
   printk(KERN_INFO "physical bar address %pa, size %llu\n", &phys, psize);
 
-  if (vsize > psize)
+  if (off + vsize > psize)
     return -EINVAL;
-  /*
-   * pages must not be cached as this would result in cache line sized
-   * accesses to the end point
-   */
-  vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+  if (off == XDMA_BYPASS_POST_WINDOW_OFFSET && vsize <= XDMA_BYPASS_POST_WINDOW_SIZE) {
+    /*
+     * the post window only takes whole commands, stores to it may be
+     * combined into cache line sized writes
+     */
+    vma->vm_page_prot = pgprot_writecombine(vma->vm_page_prot);
+  } else if (off < XDMA_BYPASS_POST_WINDOW_OFFSET + XDMA_BYPASS_POST_WINDOW_SIZE &&
+             off + vsize > XDMA_BYPASS_POST_WINDOW_OFFSET) {
+    /* a second, uncached mapping would change the type of the window */
+    return -EINVAL;
+  } else {
+    /*
+     * pages must not be cached as this would result in cache line sized
+     * accesses to the end point
+     */
+    vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+  }
   /*
    * prevent touching the pages (byte access) for swap-in,
    * and prevent the pages from being swapped out
    */
   vma->vm_flags |= VM_IO | VM_DONTEXPAND | VM_DONTDUMP;
   /* make MMIO accessible to user space */
-  rc = io_remap_pfn_range(vma, vma->vm_start, phys >> PAGE_SHIFT,
+  rc = io_remap_pfn_range(vma, vma->vm_start, (phys + off) >> PAGE_SHIFT,
       vsize, vma->vm_page_prot);
   printk(KERN_INFO "vma=0x%p, vma->vm_start=0x%lx, phys=0x%llx, size=%lu = %d\n",
     vma, vma->vm_start, phys >> PAGE_SHIFT, vsize, rc);
@@ -389,14 +404,40 @@ static const struct file_operations xdma_bypass_fops = {
 
 /* IOCTL */
 
-static int ioctl_do_buffer_set(struct dev_inst *inst, unsigned long arg)
+/* Unpins the buffer and forgets it, also called on close, when the process
+ * may already have lost its address space. */
+static void release_huge_pages(struct dev_inst *inst)
+{
+  unsigned long i;
+
+  for (i = 0; i < inst->huge_npages; i++) {
+    struct page *const  pg = inst->huge_pages[i];
+    if (!PageReserved(pg)) {
+      SetPageDirty(pg);
+    }
+    put_page(pg);
+  }
+  //dealloc pages
+  vfree(inst->huge_pages);
+  inst->huge_pages = NULL;
+  inst->huge_mm = NULL;
+  inst->huge_file = NULL;
+  inst->huge_user_addr = 0;
+  inst->huge_size = 0;
+  inst->huge_npages = 0;
+  inst->huge_hnpages = 0;
+}
+
+static int ioctl_do_buffer_set(struct dev_inst *inst, struct file *file, unsigned long arg)
 {
   int rc;
   struct xdma_huge huge;
   unsigned long npages;
   unsigned long buffer_start;
   unsigned long bufsize;
+  unsigned long offset = 0;
   unsigned npage_count = 0;
+  struct page **pages;
   int i;
 
   printk(KERN_INFO "IOCTL_XDMA_BUFFER_SET\n");
@@ -412,18 +453,34 @@ static int ioctl_do_buffer_set(struct dev_inst *inst, unsigned long arg)
   npages = 1 + (bufsize - 1) / PAGE_SIZE;
   printk(KERN_INFO "req npages %lu\n", npages);
   printk(KERN_INFO "dev_inst ptr: %p\n", inst);
-  inst->huge_pages = vmalloc(npages * sizeof(struct page*));
+
+  /* A buffer of the same process directly behind the pinned one is appended
+   * to it, the pages pinned so far and their mappings stay untouched. Any
+   * other buffer replaces the pinned one. */
+  if (inst->huge_pages != NULL && inst->huge_mm == current->mm &&
+      buffer_start == inst->huge_user_addr + inst->huge_size) {
+    offset = inst->huge_npages;
+    printk(KERN_INFO "append to buffer at 0x%lx\n", inst->huge_user_addr);
+  } else if (inst->huge_pages != NULL) {
+    printk(KERN_INFO "replace buffer at 0x%lx\n", inst->huge_user_addr);
+    release_huge_pages(inst);
+  }
+  pages = vmalloc((offset + npages) * sizeof(struct page*));
+  if (pages == NULL) {
+    return -ENOMEM;
+  }
 
   printk(KERN_INFO "get_user_pages\n");
   down_read(&current->mm->mmap_sem);
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 9, 0)
-  rc = get_user_pages(buffer_start, npages, 1, inst->huge_pages, NULL);
+  rc = get_user_pages(buffer_start, npages, 1, pages + offset, NULL);
 #else
   rc = get_user_pages(current, current->mm, buffer_start, npages,
-                      1 /* Write enable */, 0 /* Force */, inst->huge_pages, NULL);
+                      1 /* Write enable */, 0 /* Force */, pages + offset, NULL);
 #endif
   up_read(&current->mm->mmap_sem);
-  if (rc == 0) {
+  if (rc <= 0) {
+    vfree(pages);
     return -1;
   }
   npages = rc;
@@ -431,17 +488,28 @@ static int ioctl_do_buffer_set(struct dev_inst *inst, unsigned long arg)
   printk(KERN_INFO "size of unsigned long: %lu\n", sizeof(unsigned long));
 
   for (i=0; i < npages; i++) {
-      SetPageReserved(inst->huge_pages[i]);
+      SetPageReserved(pages[offset + i]);
       if (i % 512 == 0) {
-        //printk(KERN_INFO "huge dma_addr: %p\n", page_to_phys(inst->huge_pages[i]));
+        //printk(KERN_INFO "huge dma_addr: %p\n", page_to_phys(pages[offset + i]));
         npage_count++;
       }
   }
-  inst->huge_user_addr = huge.addr;
-  inst->huge_size = npages * 4096;
-  inst->huge_npages = npages;
-  inst->huge_hnpages = npage_count;
-  printk(KERN_INFO "huge npages: %u\n", npage_count);
+  if (offset > 0) {
+    memcpy(pages, inst->huge_pages, offset * sizeof(struct page*));
+    vfree(inst->huge_pages);
+    inst->huge_size += npages * 4096;
+    inst->huge_npages += npages;
+    inst->huge_hnpages += npage_count;
+  } else {
+    inst->huge_mm = current->mm;
+    inst->huge_file = file;
+    inst->huge_user_addr = huge.addr;
+    inst->huge_size = npages * 4096;
+    inst->huge_npages = npages;
+    inst->huge_hnpages = npage_count;
+  }
+  inst->huge_pages = pages;
+  printk(KERN_INFO "huge npages: %lu\n", inst->huge_hnpages);
 
   return 0;
 }
@@ -451,8 +519,7 @@ static int ioctl_do_mapping_get(struct dev_inst *inst, unsigned long arg)
   int rc;
   struct xdma_huge_mapping map;
   unsigned long* dma_addr;
-  int i, j;
-  int npages;
+  unsigned long j;
 
   printk(KERN_INFO "IOCTL_MAPPING_GET\n");
   rc = copy_from_user(&map, (struct xdma_huge_mapping*)arg, sizeof(struct xdma_huge_mapping));
@@ -460,19 +527,20 @@ static int ioctl_do_mapping_get(struct dev_inst *inst, unsigned long arg)
     return rc;
   }
 
-  if (map.npages < inst->huge_hnpages) {
+  if (map.npages == 0 || map.offset >= inst->huge_hnpages) {
     return -EFAULT;
   }
 
-  map.npages = inst->huge_hnpages;
-  npages = inst->huge_npages;
-  dma_addr = kmalloc(sizeof(unsigned long*) * map.npages, GFP_KERNEL);
-  for (i = 0, j = 0; i < npages; i++) { //TODO += 512
-    if (i % 512 == 0) {
-      //printk(KERN_INFO "dma_addr: %p\n", page_to_phys(inst->huge_pages[i]));
-      dma_addr[j] = page_to_phys(inst->huge_pages[i]);
-      j++;
-    }
+  // Only the requested range, a part pinned last does not rescan the buffer
+  if (map.npages > inst->huge_hnpages - map.offset) {
+    map.npages = inst->huge_hnpages - map.offset;
+  }
+  dma_addr = kmalloc(sizeof(unsigned long) * map.npages, GFP_KERNEL);
+  if (!dma_addr) {
+    return -ENOMEM;
+  }
+  for (j = 0; j < map.npages; j++) {
+    dma_addr[j] = page_to_phys(inst->huge_pages[(map.offset + j) * 512]);
   }
   printk(KERN_INFO "copy to user size: %lu\n", sizeof(struct xdma_huge_mapping));
 
@@ -480,7 +548,7 @@ static int ioctl_do_mapping_get(struct dev_inst *inst, unsigned long arg)
     goto error;
   }
 
-  if (copy_to_user(map.dma_addr, dma_addr, sizeof(unsigned long*) * map.npages)) {
+  if (copy_to_user(map.dma_addr, dma_addr, sizeof(unsigned long) * map.npages)) {
     goto error;
   }
 
@@ -494,23 +562,8 @@ error:
 
 static int ioctl_release_mapping(struct dev_inst *inst)
 {
-  int npages = inst->huge_npages;
-  int i;
-
   printk(KERN_INFO "IOCTL_XDMA_RELEASE");
-  for (i = 0; i < npages; i++) {
-    struct page *const  pg = inst->huge_pages[i];
-    printk(KERN_INFO "release dma_addr: %p\n", pg);
-    down_read(&current->mm->mmap_sem);
-    if (!PageReserved(pg)) {
-      SetPageDirty(pg);
-    }
-    put_page(pg);
-    up_read(&current->mm->mmap_sem);
-
-  }
-  //dealloc pages
-  vfree(inst->huge_pages);
+  release_huge_pages(inst);
 
   return 0;
 }
@@ -525,7 +578,7 @@ static long char_xdma_ioctl(struct file *file, unsigned int cmd, unsigned long a
 
   switch (cmd) {
     case IOCTL_XDMA_BUFFER_SET:
-      rc = ioctl_do_buffer_set(inst, arg);
+      rc = ioctl_do_buffer_set(inst, file, arg);
       break;
     case IOCTL_XDMA_MAPPING_GET:
       rc = ioctl_do_mapping_get(inst, arg);
@@ -926,15 +979,25 @@ fail:
 }
 
 int xdma_open(struct inode *inode, struct file *file) {
+   struct miscdevice *node;
    struct dev_inst *inst;
 
-   inst = container_of(inode->i_cdev, struct dev_inst, cdev);
+   /* misc_open passes the opened node, its parent is the card. */
+   node = (struct miscdevice *)file->private_data;
+   inst = dev_get_drvdata(node->parent);
    file->private_data = inst;
 
    return 0;
 }
 
 int xdma_release(struct inode *inode, struct file *file) {
+   struct dev_inst *inst = (struct dev_inst*)file->private_data;
+
+   /* Pages pinned through this file must not outlive the process. */
+   if (inst->huge_pages != NULL && inst->huge_file == file) {
+      printk(KERN_INFO "release buffer at 0x%lx on close\n", inst->huge_user_addr);
+      release_huge_pages(inst);
+   }
    return 0;
 }
 
@@ -1283,28 +1346,42 @@ probe(struct pci_dev *pdev, const struct pci_device_id *id) {
     /* Flush writes */
     //read_interrupts(inst);
 
-    /* Create /dev/xdma_control. */
-    misc_dev_node.minor= MISC_DYNAMIC_MINOR;
-    misc_dev_node.name= "xdma_control";
-    misc_dev_node.fops= &xdma_fops;
-    misc_dev_node.parent= &pdev->dev;
-    printk(KERN_INFO "Creating /dev/xdma_control (%p)\n", &misc_dev_node);
-    rc= misc_register(&misc_dev_node);
-    if(rc < 0) {
-        printk(KERN_ERR "Failed to create /dev/xdma_control.\n");
+    /* Create /dev/xdma_control, further cards get /dev/xdma_control<n>. */
+    rc = ida_simple_get(&instance_ida, 0, 0, GFP_KERNEL);
+    if (rc < 0) {
+        printk(KERN_ERR "Failed to allocate a card index.\n");
         goto err_misc_register;
     }
+    inst->instance = rc;
+    if (inst->instance == 0) {
+        snprintf(inst->control_name, sizeof(inst->control_name), "xdma_control");
+        snprintf(inst->bypass_name, sizeof(inst->bypass_name), "xdma_bypass");
+    } else {
+        snprintf(inst->control_name, sizeof(inst->control_name), "xdma_control%d", inst->instance);
+        snprintf(inst->bypass_name, sizeof(inst->bypass_name), "xdma_bypass%d", inst->instance);
+    }
+    inst->control_node.minor= MISC_DYNAMIC_MINOR;
+    inst->control_node.name= inst->control_name;
+    inst->control_node.fops= &xdma_fops;
+    inst->control_node.parent= &pdev->dev;
+    printk(KERN_INFO "Creating /dev/%s (%p)\n", inst->control_name, &inst->control_node);
+    rc= misc_register(&inst->control_node);
+    if(rc < 0) {
+        printk(KERN_ERR "Failed to create /dev/%s.\n", inst->control_name);
+        goto err_control_register;
+    }
 
     /* Create /dev/xdma_bypass. */
-    bypass_node.minor= MISC_DYNAMIC_MINOR;
-    bypass_node.name= "xdma_bypass";
-    bypass_node.fops= &xdma_bypass_fops;
-    bypass_node.parent= &pdev->dev;
-    printk(KERN_INFO "Creating /dev/xdma_bypass (%p)\n", &bypass_node);
-    rc= misc_register(&bypass_node);
+    inst->bypass_node.minor= MISC_DYNAMIC_MINOR;
+    inst->bypass_node.name= inst->bypass_name;
+    inst->bypass_node.fops= &xdma_bypass_fops;
+    inst->bypass_node.parent= &pdev->dev;
+    printk(KERN_INFO "Creating /dev/%s (%p)\n", inst->bypass_name, &inst->bypass_node);
+    rc= misc_register(&inst->bypass_node);
     if(rc < 0) {
-        printk(KERN_ERR "Failed to create /dev/xdma_bypass.\n");
-        goto err_misc_register;
+        printk(KERN_ERR "Failed to create /dev/%s.\n", inst->bypass_name);
+        misc_deregister(&inst->control_node);
+        goto err_control_register;
     }
 
     /* Add sysfs attributes for control and status. */
@@ -1321,6 +1398,8 @@ probe(struct pci_dev *pdev, const struct pci_device_id *id) {
     channel_interrupts_disable(inst, 0xFFFFFFFF);
     read_interrupts(inst);
     misc_deregister(&misc_dev_node);*/
+err_control_register:
+    ida_simple_remove(&instance_ida, inst->instance);
 err_misc_register:
 err_engines:
     irq_teardown(inst);
@@ -1362,8 +1441,9 @@ remove(struct pci_dev *pdev) {
     }
 
     //sysfs_remove_groups(&misc_dev_node.this_device->kobj, attr_groups);
-    misc_deregister(&misc_dev_node);
-    misc_deregister(&bypass_node);
+    misc_deregister(&inst->control_node);
+    misc_deregister(&inst->bypass_node);
+    ida_simple_remove(&instance_ida, inst->instance);
 
     //channel_interrupts_disable(inst, 0xFFFFFFFF);
     //read_interrupts(inst);
@@ -1414,6 +1494,7 @@ xdma_driver_exit(void) {
     printk(KERN_INFO DRV_NAME" exit()\n");
     /* unregister this driver from the PCI bus driver */
     pci_unregister_driver(&pci_driver);
+    ida_destroy(&instance_ida);
 }
 
 module_init(xdma_driver_init);
@@ -7,11 +7,17 @@ unsigned long addr;
 unsigned long size;
 };
 
+/* Returns the addresses of up to npages 2 MB pages starting at page offset */
 struct xdma_huge_mapping {
 unsigned long npages;
 unsigned long* dma_addr;
+unsigned long offset;
 };
 
+/* Page of the bypass BAR that only takes command posts, mapped write-combining */
+#define XDMA_BYPASS_POST_WINDOW_OFFSET (32*1024UL)
+#define XDMA_BYPASS_POST_WINDOW_SIZE   (4*1024UL)
+
 #define IOCTL_XDMA_BUFFER_SET  _IOW('q', 1, struct xdma_huge*)
 #define IOCTL_XDMA_MAPPING_GET _IOR('q', 2, struct xdma_huge_mapping*)
 #define IOCTL_XDMA_RELEASE     _IO ('q', 3)
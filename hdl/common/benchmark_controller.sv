@@ -97,6 +97,7 @@ localparam GPIO_REG_BOARDNUM    = 8'h07;
 localparam GPIO_REG_IPADDR      = 8'h08;
 localparam GPIO_REG_IPERF_CONSUMED   = 8'h09;
 localparam GPIO_REG_IPERF_PRODUCED  = 8'h0A;
+localparam GPIO_REG_SCRATCH        = 8'h0B;
 //localparam GPIO_REG_DEBUG       = 8'h0C;
 //localparam GPIO_REG_DEBUG2      = 8'h0D;
 localparam GPIO_REG_IPERF_CYCLES     = 8'h0C;
@@ -184,6 +185,7 @@ reg[31:0] writeAddr;
 reg[31:0] readAddr;
 
 reg[7:0] word_counter;
+reg[31:0] scratch_reg;
 
 
 //handle writes
@@ -200,6 +202,7 @@ begin
         m_axis_dma_bench_cmd_valid <= 1'b0;
         
         word_counter <= 0;
+        scratch_reg <= 0;
         
         writeState <= WRITE_IDLE;
     end
@@ -226,6 +229,9 @@ begin
                     axil_bresp <= AXI_RESP_OK;
                     writeState <= WRITE_RESPONSE;
                     case (writeAddr)
+                        GPIO_REG_SCRATCH: begin
+                            scratch_reg <= axil_wdata;
+                        end
                         GPIO_REG_IPERF: begin
                             word_counter <= word_counter + 1;
                             case (word_counter)
@@ -422,6 +428,9 @@ begin
                     GPIO_REG_IPERF_PRODUCED: begin
                         axil_rdata <= iperf_produced_bytes[31:0];
                     end
+                    GPIO_REG_SCRATCH: begin
+                        axil_rdata <= scratch_reg;
+                    end
                     GPIO_REG_DDR_BENCH_CYCLES: begin
                         if (!ddr_bench_cycles_upper) begin
                             axil_rdata <= ddr_bench_execution_cycles[31:0];
@@ -346,12 +346,24 @@ axis_clock_converter_32 axis_clock_converter_tlb_page_crossing (
    .s_axis_tlb_interface_V_TVALID(axis_tlb_interface_valid),  // input wire s_axis_tlb_interface_tvalid
    .s_axis_tlb_interface_V_TREADY(axis_tlb_interface_ready),  // output wire s_axis_tlb_interface_tready
    .s_axis_tlb_interface_V_TDATA(axis_tlb_interface_data),    // input wire [135 : 0] s_axis_tlb_interface_tdata
+   //bulk TLB load is not routed yet, its command and table ports are tied off
+   .s_axis_tlb_bulk_cmd_V_TVALID(1'b0),          // input wire s_axis_tlb_bulk_cmd_tvalid
+   .s_axis_tlb_bulk_cmd_V_TREADY(),              // output wire s_axis_tlb_bulk_cmd_tready
+   .s_axis_tlb_bulk_cmd_V_TDATA('0),             // input wire [167 : 0] s_axis_tlb_bulk_cmd_tdata
+   .m_axis_tlb_table_read_cmd_V_TVALID(),        // output wire m_axis_tlb_table_read_cmd_tvalid
+   .m_axis_tlb_table_read_cmd_V_TREADY(1'b1),    // input wire m_axis_tlb_table_read_cmd_tready
+   .m_axis_tlb_table_read_cmd_V_TDATA(),         // output wire [95 : 0] m_axis_tlb_table_read_cmd_tdata
+   .s_axis_tlb_table_data_V_TVALID(1'b0),        // input wire s_axis_tlb_table_data_tvalid
+   .s_axis_tlb_table_data_V_TREADY(),            // output wire s_axis_tlb_table_data_tready
+   .s_axis_tlb_table_data_V_TDATA('0),           // input wire [583 : 0] s_axis_tlb_table_data_tdata
    .ap_clk(user_clk),                                                // input wire aclk
    .ap_rst_n(user_aresetn),                                          // input wire aresetn
    .regTlbMissCount_V(tlb_miss_count),                      // output wire [31 : 0] regTlbMissCount_V
    .regTlbMissCount_V_ap_vld(tlb_miss_count_valid),
    .regPageCrossingCount_V(tlb_page_crossing_count),                // output wire [31 : 0] regPageCrossingCount_V
-   .regPageCrossingCount_V_ap_vld(tlb_page_crossing_count_valid)  // output wire regPageCrossingCount_V_ap_vld
+   .regPageCrossingCount_V_ap_vld(tlb_page_crossing_count_valid),  // output wire regPageCrossingCount_V_ap_vld
+   .regTlbBulkEntries_V(),                                  // output wire [31 : 0] regTlbBulkEntries_V
+   .regTlbBulkEntries_V_ap_vld()                            // output wire regTlbBulkEntries_V_ap_vld
  );
 
  /*
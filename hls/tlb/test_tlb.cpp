@@ -41,8 +41,12 @@ int main()
 	hls::stream<dmaCmd>		m_axis_dma_read_cmd("m_axis_dma_read_cmd");
 	//host interface
 	hls::stream<tlbMapping> s_axis_tlb_interface("s_axis_tlb_interface");
+	hls::stream<tlbBulkCmd> s_axis_tlb_bulk_cmd("s_axis_tlb_bulk_cmd");
+	hls::stream<dmaCmd>		m_axis_tlb_table_read_cmd("m_axis_tlb_table_read_cmd");
+	hls::stream<net_axis<512> > s_axis_tlb_table_data("s_axis_tlb_table_data");
 	ap_uint<32>		regTlbMissCount;
 	ap_uint<32>		regPageCrossingCount;
+	ap_uint<32>		regTlbBulkEntries = 0;
 
 
 	s_axis_tlb_interface.write(tlbMapping(0xAABBCC00, 0x00C0000, true));
@@ -81,8 +85,12 @@ int main()
 				m_axis_dma_write_cmd,
 				m_axis_dma_read_cmd,
 				s_axis_tlb_interface,
+				s_axis_tlb_bulk_cmd,
+				m_axis_tlb_table_read_cmd,
+				s_axis_tlb_table_data,
 				regTlbMissCount,
-				regPageCrossingCount);
+				regPageCrossingCount,
+				regTlbBulkEntries);
 		count++;
 
 	}
@@ -138,6 +146,101 @@ int main()
 		std::cout << std::hex << "addr: " << cmd1.addr << ", len: " << cmd1.len << std::endl;
 	}
 
+	//Bulk load of 10 pages starting at the third page, spans two table words
+	const ap_uint<64> baseVaddr = 0xAABBCC00;
+	const ap_uint<64> pageSize = 2*1024*1024;
+	const ap_uint<64> tableAddr = 0x1000;
+	const uint32_t numEntries = 10;
+	s_axis_tlb_bulk_cmd.write(tlbBulkCmd(baseVaddr + 2*pageSize, tableAddr, numEntries, false));
+
+	count = 0;
+	while (count < 100)
+	{
+		if (count == 10)
+		{
+			if (m_axis_tlb_table_read_cmd.empty())
+			{
+				rc = -1;
+				std::cerr << "[ERROR] no table read" << std::endl;
+			}
+			while (!m_axis_tlb_table_read_cmd.empty())
+			{
+				m_axis_tlb_table_read_cmd.read(cmd1);
+				if (cmd1.addr != tableAddr || cmd1.len != numEntries*8)
+				{
+					rc = -1;
+					std::cerr << "[ERROR] table read" << std::endl;
+				}
+				std::cout << std::hex << "table addr: " << cmd1.addr << ", len: " << cmd1.len << std::endl;
+			}
+			//Table data, the last word is only partially used
+			for (uint32_t w = 0; w < (numEntries+7)/8; w++)
+			{
+				net_axis<512> word;
+				word.data = 0;
+				word.keep = 0;
+				for (uint32_t i = 0; i < 8 && (w*8+i) < numEntries; i++)
+				{
+					ap_uint<64> paddr = 0x40000000 + (w*8+i)*pageSize;
+					word.data(i*64+63, i*64) = paddr;
+					word.keep(i*8+7, i*8) = 0xFF;
+				}
+				word.last = (w == (numEntries-1)/8);
+				s_axis_tlb_table_data.write(word);
+			}
+		}
+		if (count == 50)
+		{
+			//translate every bulk loaded page
+			for (uint32_t i = 0; i < numEntries; i++)
+			{
+				s_axis_mem_read_cmd.write(memCmd(0x11, baseVaddr + (2+i)*pageSize + 0x40, 0x20));
+			}
+		}
+
+		tlb(	s_axis_mem_write_cmd,
+				s_axis_mem_read_cmd,
+#ifdef USE_DDR
+				m_axis_ddr_write_cmd,
+				m_axis_ddr_read_cmd,
+#endif
+				m_axis_dma_write_cmd,
+				m_axis_dma_read_cmd,
+				s_axis_tlb_interface,
+				s_axis_tlb_bulk_cmd,
+				m_axis_tlb_table_read_cmd,
+				s_axis_tlb_table_data,
+				regTlbMissCount,
+				regPageCrossingCount,
+				regTlbBulkEntries);
+		count++;
+	}
+
+	if (regTlbBulkEntries != numEntries)
+	{
+		rc = -1;
+		std::cerr << "[ERROR] bulk entries: " << regTlbBulkEntries << std::endl;
+	}
+	std::cout << "DMA READ (bulk)" << std::endl;
+	uint32_t numReads = 0;
+	while (!m_axis_dma_read_cmd.empty())
+	{
+		m_axis_dma_read_cmd.read(cmd1);
+		ap_uint<64> expected = 0x40000000 + numReads*pageSize + 0x40;
+		if (cmd1.addr != expected || cmd1.len != 0x20)
+		{
+			rc = -1;
+			std::cerr << "[ERROR] dma read after bulk load" << std::endl;
+		}
+		std::cout << std::hex << "addr: " << cmd1.addr << ", len: " << cmd1.len << std::endl;
+		numReads++;
+	}
+	if (numReads != numEntries)
+	{
+		rc = -1;
+		std::cerr << "[ERROR] dma reads after bulk load: " << numReads << std::endl;
+	}
+
 	std::cout << "Misses: " << regTlbMissCount << std::endl;
 	std::cout << "Page crossings: " << regPageCrossingCount << std::endl;
 	return rc;
@@ -41,9 +41,13 @@ void tlb(	hls::stream<memCmd>& 	s_axis_mem_write_cmd,
 			hls::stream<dmaCmd>&		m_axis_dma_read_cmd,
 			//host interface
 			hls::stream<tlbMapping>& s_axis_tlb_interface,
+			hls::stream<tlbBulkCmd>& s_axis_tlb_bulk_cmd,
+			hls::stream<dmaCmd>&		m_axis_tlb_table_read_cmd,
+			hls::stream<net_axis<512> >& s_axis_tlb_table_data,
 			//debug out
 			ap_uint<32>&		regTlbMissCount,
-			ap_uint<32>&		regPageCrossingCount)
+			ap_uint<32>&		regPageCrossingCount,
+			ap_uint<32>&		regTlbBulkEntries)
 {
 #pragma HLS PIPELINE II=1
 #pragma HLS INTERFACE ap_ctrl_none port=return
@@ -57,6 +61,9 @@ void tlb(	hls::stream<memCmd>& 	s_axis_mem_write_cmd,
 #pragma HLS INTERFACE axis register port=m_axis_dma_write_cmd
 #pragma HLS INTERFACE axis register port=m_axis_dma_read_cmd
 #pragma HLS INTERFACE axis register port=s_axis_tlb_interface
+#pragma HLS INTERFACE axis register port=s_axis_tlb_bulk_cmd
+#pragma HLS INTERFACE axis register port=m_axis_tlb_table_read_cmd
+#pragma HLS INTERFACE axis register port=s_axis_tlb_table_data
 
 #pragma HLS DATA_PACK variable=s_axis_mem_write_cmd
 #pragma HLS DATA_PACK variable=s_axis_mem_read_cmd
@@ -67,9 +74,13 @@ void tlb(	hls::stream<memCmd>& 	s_axis_mem_write_cmd,
 #pragma HLS DATA_PACK variable=m_axis_dma_write_cmd
 #pragma HLS DATA_PACK variable=m_axis_dma_read_cmd
 #pragma HLS DATA_PACK variable=s_axis_tlb_interface
+#pragma HLS DATA_PACK variable=s_axis_tlb_bulk_cmd
+#pragma HLS DATA_PACK variable=m_axis_tlb_table_read_cmd
+#pragma HLS DATA_PACK variable=s_axis_tlb_table_data
 
 #pragma HLS INTERFACE ap_vld port=regTlbMissCount
 #pragma HLS INTERFACE ap_vld port=regPageCrossingCount
+#pragma HLS INTERFACE ap_vld port=regTlbBulkEntries
 
 
 
@@ -78,9 +89,17 @@ void tlb(	hls::stream<memCmd>& 	s_axis_mem_write_cmd,
 	static ap_uint<32> top_page_base = 0;
 	static ap_uint<32> tlbMissCounter = 0;
 	static ap_uint<32> tlbPageCrossingCounter = 0;
+	//bulk load state, one entry is written per cycle
+	static ap_uint<32> bulkPage = 0;
+	static ap_uint<32> bulkRemaining = 0;
+	static ap_uint<3> bulkWordIdx = 0;
+	static ap_uint<512> bulkWord = 0;
+	static ap_uint<32> bulkEntriesCounter = 0;
 
 	memCmd cmd;
 	tlbMapping newMapping;
+	tlbBulkCmd bulkCmd;
+	net_axis<512> tableWord;
 	ap_uint<64> pbase;
 
 	//TODO priority?
@@ -141,4 +160,45 @@ void tlb(	hls::stream<memCmd>& 	s_axis_mem_write_cmd,
 			top_page_base = page_base;
 		}
 	}
+	else if (bulkRemaining != 0 && (bulkWordIdx != 0 || !s_axis_tlb_table_data.empty()))
+	{
+		//8 entries per 512-bit word, the last word might be partially used
+		ap_uint<512> word = bulkWord;
+		if (bulkWordIdx == 0)
+		{
+			s_axis_tlb_table_data.read(tableWord);
+			word = tableWord.data;
+		}
+		tlb_table[bulkPage].paddr = word(47, 0);
+		if (bulkPage > top_page_base)
+		{
+			top_page_base = bulkPage;
+		}
+		bulkWord = (word >> 64);
+		bulkWordIdx++;
+		bulkPage++;
+		bulkRemaining--;
+		if (bulkRemaining == 0)
+		{
+			bulkWordIdx = 0;
+		}
+		bulkEntriesCounter++;
+		regTlbBulkEntries = bulkEntriesCounter;
+	}
+	else if (bulkRemaining == 0 && !s_axis_tlb_bulk_cmd.empty())
+	{
+		s_axis_tlb_bulk_cmd.read(bulkCmd);
+		if (bulkCmd.isBase)
+		{
+			base_vaddr = bulkCmd.vaddr;
+		}
+		ap_uint<64> addr = bulkCmd.vaddr - base_vaddr;
+		bulkPage = (addr >> 21);
+		bulkRemaining = bulkCmd.numEntries;
+		bulkWordIdx = 0;
+		if (bulkCmd.numEntries != 0)
+		{
+			m_axis_tlb_table_read_cmd.write(dmaCmd(bulkCmd.tableAddr, bulkCmd.numEntries * 8));
+		}
+	}
 }
@@ -53,6 +53,21 @@ struct tlbMapping
 		:vaddr(vaddr), paddr(paddr), isBase(isBase) {}
 };
 
+/*
+ * Bulk load of consecutive 2MB pages starting at vaddr, the table in host memory
+ * holds one 64-bit physical address per page.
+ */
+struct tlbBulkCmd
+{
+	ap_uint<64> vaddr;
+	ap_uint<64> tableAddr;
+	ap_uint<32> numEntries;
+	bool		isBase;
+	tlbBulkCmd() {}
+	tlbBulkCmd(ap_uint<64> vaddr, ap_uint<64> tableAddr, ap_uint<32> numEntries, bool isBase)
+		:vaddr(vaddr), tableAddr(tableAddr), numEntries(numEntries), isBase(isBase) {}
+};
+
 struct tlbEntry
 {
 	ap_uint<48> paddr;
@@ -71,7 +86,11 @@ void tlb(	hls::stream<memCmd>& 	s_axis_mem_write_cmd,
 			hls::stream<dmaCmd>&		m_axis_dma_read_cmd,
 			//host interface
 			hls::stream<tlbMapping>& s_axis_tlb_interface,
+			hls::stream<tlbBulkCmd>& s_axis_tlb_bulk_cmd,
+			hls::stream<dmaCmd>&		m_axis_tlb_table_read_cmd,
+			hls::stream<net_axis<512> >& s_axis_tlb_table_data,
 			ap_uint<32>&		regTlbMissCount,
-			ap_uint<32>&		regPageCrossingCount);
+			ap_uint<32>&		regPageCrossingCount,
+			ap_uint<32>&		regTlbBulkEntries);
 
 #endif
@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <boost/program_options.hpp>
+
+#include <fpga/Configuration.h>
+#include <fpga/MemoryManager.h>
+#include <fpga/ScratchArena.h>
+#include <fpga/ThreadCache.h>
+#include "barrier.hpp"
+
+/*
+ * Measures allocate/free cost of the DMA memory manager as the number of live
+ * allocations grows, and allocate/free throughput as the number of threads
+ * grows, with and without the per-thread caches. Runs on anonymous memory,
+ * no FPGA is required.
+ *
+ * With --arena it measures the per-repetition setup of a result area
+ * instead, clearing all of it versus resetting a scratch arena that only
+ * clears the polled word of every value.
+ */
+
+static unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
+
+uint64_t randomSize(std::default_random_engine& rand_gen, uint32_t smallPercentage) {
+   std::uniform_int_distribution<uint32_t> kind(0, 99);
+   if (kind(rand_gen) < smallPercentage) {
+      std::uniform_int_distribution<uint64_t> small(8, fpga::MemoryManager::MAX_SLAB_OBJECT);
+      return small(rand_gen);
+   }
+   std::uniform_int_distribution<uint64_t> large(fpga::MemoryManager::MAX_SLAB_OBJECT + 1, 64*1024);
+   return large(rand_gen);
+}
+
+// huge pages are counted from the start of the region, as in the FPGA TLB
+bool crossesHugePage(void* region, void* ptr, uint64_t size) {
+   uint64_t offset = ((char*) ptr) - ((char*) region);
+   uint64_t first = offset / fpga::Configuration::HUGE_PAGE_SIZE;
+   uint64_t last = (offset + size - 1) / fpga::Configuration::HUGE_PAGE_SIZE;
+   return (first != last);
+}
+
+void runLiveSweep(fpga::MemoryManager* mm, void* region, uint32_t maxLive, uint32_t numberOfOperations, uint32_t smallPercentage, bool zero) {
+   std::default_random_engine rand_gen(seed);
+   std::cout << "Live allocations\tns per allocate+free\tlive allocations crossing a huge page" << std::endl;
+
+   for (uint32_t live = 1024; live <= maxLive; live *= 2) {
+      std::vector<void*> allocations;
+      std::vector<uint64_t> allocationSizes;
+      allocations.reserve(live);
+      allocationSizes.reserve(live);
+      for (uint32_t i = 0; i < live; ++i) {
+         uint64_t size = randomSize(rand_gen, smallPercentage);
+         void* ptr = mm->allocate(size, zero);
+         if (ptr == nullptr) {
+            std::cerr << "[ERROR] region too small for " << live << " live allocations" << std::endl;
+            return;
+         }
+         allocations.push_back(ptr);
+         allocationSizes.push_back(size);
+      }
+
+      //Pre-compute the access pattern so that only the allocator is timed
+      std::uniform_int_distribution<uint32_t> index(0, live-1);
+      std::vector<uint32_t> victims(numberOfOperations);
+      std::vector<uint64_t> sizes(numberOfOperations);
+      for (uint32_t i = 0; i < numberOfOperations; ++i) {
+         victims[i] = index(rand_gen);
+         sizes[i] = randomSize(rand_gen, smallPercentage);
+      }
+
+      auto start = std::chrono::high_resolution_clock::now();
+      for (uint32_t i = 0; i < numberOfOperations; ++i) {
+         mm->free(allocations[victims[i]]);
+         allocations[victims[i]] = mm->allocate(sizes[i], zero);
+      }
+      auto end = std::chrono::high_resolution_clock::now();
+      double durationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count();
+
+      uint32_t crossings = 0;
+      for (uint32_t i = 0; i < numberOfOperations; ++i) {
+         allocationSizes[victims[i]] = sizes[i];
+      }
+      for (uint32_t i = 0; i < live; ++i) {
+         if (crossesHugePage(region, allocations[i], allocationSizes[i])) {
+            crossings++;
+         }
+      }
+
+      std::cout << std::fixed << "#" << live << "\t" << (durationNs / numberOfOperations) << "\t" << crossings << std::endl;
+      if (live * 2 > maxLive) {
+         mm->printStats();
+      }
+
+      for (void* ptr : allocations) {
+         mm->free(ptr);
+      }
+   }
+}
+
+void stressThread(fpga::MemoryManager* mm, bool useCache, uint32_t numberOfOperations, uint32_t smallPercentage, bool zero, uint32_t threadId, barrier_t* barrier) {
+   static const uint32_t workingSet = 64;
+   std::default_random_engine rand_gen(seed + threadId);
+   std::uniform_int_distribution<uint32_t> index(0, workingSet-1);
+   std::vector<uint32_t> victims(numberOfOperations);
+   std::vector<uint64_t> sizes(numberOfOperations);
+   for (uint32_t i = 0; i < numberOfOperations; ++i) {
+      victims[i] = index(rand_gen);
+      sizes[i] = randomSize(rand_gen, smallPercentage);
+   }
+
+   void* allocations[workingSet];
+   for (uint32_t i = 0; i < workingSet; ++i) {
+      allocations[i] = useCache ? fpga::ThreadCache::allocate(mm, sizes[i], zero) : mm->allocate(sizes[i], zero);
+   }
+
+   barrier_cross(barrier);
+   for (uint32_t i = 0; i < numberOfOperations; ++i) {
+      void*& chunk = allocations[victims[i]];
+      if (useCache) {
+         fpga::ThreadCache::free(mm, chunk);
+         chunk = fpga::ThreadCache::allocate(mm, sizes[i], zero);
+      } else {
+         mm->free(chunk);
+         chunk = mm->allocate(sizes[i], zero);
+      }
+   }
+   barrier_cross(barrier);
+
+   for (uint32_t i = 0; i < workingSet; ++i) {
+      if (useCache) {
+         fpga::ThreadCache::free(mm, allocations[i]);
+      } else {
+         mm->free(allocations[i]);
+      }
+   }
+   fpga::ThreadCache::flush();
+}
+
+void runThreadSweep(fpga::MemoryManager* mm, uint32_t maxThreads, uint32_t numberOfOperations, uint32_t smallPercentage, bool zero) {
+   std::cout << "Threads\tMops/s global pool\tMops/s thread cache" << std::endl;
+
+   for (uint32_t numberOfThreads = 1; numberOfThreads <= maxThreads; numberOfThreads *= 2) {
+      double rates[2];
+      for (int useCache = 0; useCache < 2; ++useCache) {
+         barrier_t barrier;
+         barrier_init(&barrier, numberOfThreads + 1);
+         std::vector<std::thread> threads;
+         for (uint32_t t = 0; t < numberOfThreads; ++t) {
+            threads.emplace_back(stressThread, mm, (bool) useCache, numberOfOperations, smallPercentage, zero, t, &barrier);
+         }
+         barrier_cross(&barrier);
+         auto start = std::chrono::high_resolution_clock::now();
+         barrier_cross(&barrier);
+         auto end = std::chrono::high_resolution_clock::now();
+         for (std::thread& thread : threads) {
+            thread.join();
+         }
+         double durationUs = std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count() / 1000.0;
+         rates[useCache] = ((double) numberOfThreads) * numberOfOperations / durationUs;
+      }
+      std::cout << std::fixed << "#" << numberOfThreads << "\t" << rates[0] << "\t" << rates[1] << std::endl;
+   }
+}
+
+void runArenaSweep(fpga::MemoryManager* mm, uint64_t valueSize, uint32_t numberOfOperations) {
+   std::cout << "Result size[B]\tus per memset\tus per arena reset+allocate" << std::endl;
+   uint32_t repetitions = std::max<uint32_t>(1, numberOfOperations / 1000);
+
+   for (uint64_t resultSize = 64*1024; resultSize <= 64*1024*1024; resultSize *= 4) {
+      uint64_t numberOfValues = resultSize / valueSize;
+      char* result = (char*) mm->allocate(resultSize, true);
+      if (result == nullptr) {
+         std::cerr << "[ERROR] region too small for a result of " << resultSize << std::endl;
+         return;
+      }
+
+      auto start = std::chrono::high_resolution_clock::now();
+      for (uint32_t r = 0; r < repetitions; ++r) {
+         memset(result, 0, resultSize);
+         //The FPGA writes every value
+         for (uint64_t v = 0; v < numberOfValues; ++v) {
+            ((volatile uint64_t*) (result + (v+1)*valueSize))[-1] = 1;
+         }
+      }
+      double memsetUs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now()-start).count() / 1000.0;
+
+      fpga::ScratchArena arena(result, resultSize);
+      start = std::chrono::high_resolution_clock::now();
+      for (uint32_t r = 0; r < repetitions; ++r) {
+         arena.reset();
+         for (uint64_t v = 0; v < numberOfValues; ++v) {
+            char* value = (char*) arena.allocate(valueSize, sizeof(uint64_t));
+            volatile uint64_t* pollPtr = ((uint64_t*) (value + valueSize)) - 1;
+            arena.mark(pollPtr);
+            *pollPtr = 1;
+         }
+      }
+      double arenaUs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now()-start).count() / 1000.0;
+
+      std::cout << std::fixed << "#" << resultSize << "\t" << (memsetUs / repetitions) << "\t" << (arenaUs / repetitions) << std::endl;
+      mm->free(result);
+   }
+}
+
+int main(int argc, char *argv[]) {
+
+   boost::program_options::options_description programDescription("Allowed options");
+   programDescription.add_options()("memorySize,m", boost::program_options::value<uint64_t>(), "Size of the memory region in bytes, default: 1GiB")
+                                    ("maxLive,l", boost::program_options::value<uint32_t>(), "Maximum number of live allocations, default: 65536")
+                                    ("operations,o", boost::program_options::value<uint32_t>(), "Number of free/allocate pairs per measurement and thread, default: 100000")
+                                    ("small,s", boost::program_options::value<uint32_t>(), "Percentage of sub-page allocations, default: 80")
+                                    ("threads,t", boost::program_options::value<uint32_t>(), "Run the multi-threaded stress test up to this number of threads")
+                                    ("zero,z", boost::program_options::value<bool>(), "Request zeroed memory on allocate, default: false")
+                                    ("backgroundZeroing,b", boost::program_options::value<bool>(), "Run the background zeroing thread, default: false")
+                                    ("hugePageAligned,a", boost::program_options::value<bool>(), "Never place allocations across a huge page, default: false")
+                                    ("arena,r", boost::program_options::value<uint64_t>(), "Measure result area setup for values of this size in bytes");
+
+   boost::program_options::variables_map commandLineArgs;
+   boost::program_options::store(boost::program_options::parse_command_line(argc, argv, programDescription), commandLineArgs);
+   boost::program_options::notify(commandLineArgs);
+
+   uint64_t memorySize = 1024UL*1024*1024;
+   uint32_t maxLive = 65536;
+   uint32_t numberOfOperations = 100000;
+   uint32_t smallPercentage = 80;
+   uint32_t maxThreads = 0;
+   bool zero = false;
+   bool backgroundZeroing = false;
+   bool hugePageAligned = false;
+   uint64_t arenaValueSize = 0;
+
+   if (commandLineArgs.count("memorySize") > 0) {
+      memorySize = commandLineArgs["memorySize"].as<uint64_t>();
+   }
+   if (commandLineArgs.count("maxLive") > 0) {
+      maxLive = commandLineArgs["maxLive"].as<uint32_t>();
+   }
+   if (commandLineArgs.count("operations") > 0) {
+      numberOfOperations = commandLineArgs["operations"].as<uint32_t>();
+   }
+   if (commandLineArgs.count("small") > 0) {
+      smallPercentage = commandLineArgs["small"].as<uint32_t>();
+   }
+   if (commandLineArgs.count("threads") > 0) {
+      maxThreads = commandLineArgs["threads"].as<uint32_t>();
+   }
+   if (commandLineArgs.count("zero") > 0) {
+      zero = commandLineArgs["zero"].as<bool>();
+   }
+   if (commandLineArgs.count("backgroundZeroing") > 0) {
+      backgroundZeroing = commandLineArgs["backgroundZeroing"].as<bool>();
+   }
+   if (commandLineArgs.count("hugePageAligned") > 0) {
+      hugePageAligned = commandLineArgs["hugePageAligned"].as<bool>();
+   }
+   if (commandLineArgs.count("arena") > 0) {
+      arenaValueSize = commandLineArgs["arena"].as<uint64_t>();
+      if (arenaValueSize < sizeof(uint64_t) || arenaValueSize % sizeof(uint64_t) != 0) {
+         std::cerr << "[ERROR] value size has to be a multiple of 8" << std::endl;
+         return 1;
+      }
+   }
+
+   void* region = mmap(0, memorySize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   if (region == MAP_FAILED) {
+      std::cerr << "[ERROR] on mmap of benchmark region" << std::endl;
+      return 1;
+   }
+   //Fresh anonymous memory is already zeroed
+   fpga::MemoryManager* mm = new fpga::MemoryManager(region, memorySize, true);
+   if (backgroundZeroing) {
+      mm->startZeroing();
+   }
+   if (hugePageAligned) {
+      mm->setHugePageBoundary(fpga::Configuration::HUGE_PAGE_SIZE);
+   }
+
+   if (arenaValueSize > 0) {
+      runArenaSweep(mm, arenaValueSize, numberOfOperations);
+   } else if (maxThreads > 0) {
+      runThreadSweep(mm, maxThreads, numberOfOperations, smallPercentage, zero);
+   } else {
+      runLiveSweep(mm, region, maxLive, numberOfOperations, smallPercentage, zero);
+   }
+
+   delete mm;
+   munmap(region, memorySize);
+
+	return 0;
+
+}
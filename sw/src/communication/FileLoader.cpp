@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "FileLoader.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace communication {
+
+FileLoader::FileLoader(HardRoceCommunicator* communicator, uint64_t chunkSize, uint32_t numberOfReaders)
+   :communicator(communicator), numberOfReaders(numberOfReaders)
+{
+   //Direct reads have to cover whole blocks
+   this->chunkSize = bufferSize(chunkSize);
+   if (this->numberOfReaders == 0) {
+      this->numberOfReaders = 1;
+   }
+}
+
+uint64_t FileLoader::fileSize(const char* path) {
+   struct stat fileStat;
+   if (stat(path, &fileStat) != 0) {
+      std::cerr << "[ERROR] on stat of " << path << std::endl;
+      return 0;
+   }
+   return fileStat.st_size;
+}
+
+uint64_t FileLoader::bufferSize(uint64_t fileSize) {
+   return ((fileSize + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT) * DIRECT_IO_ALIGNMENT;
+}
+
+uint64_t FileLoader::load(const char* path, void* buffer, uint64_t size) {
+   return transfer(path, buffer, size, false, 0, 0, nullptr);
+}
+
+uint64_t FileLoader::loadAndPut(const char* path, void* buffer, uint64_t size, int targetProcess, uint64_t targetOffset, RoceWin* win) {
+   return transfer(path, buffer, size, true, targetProcess, targetOffset, win);
+}
+
+/*
+ * Reader threads claim chunks in order and read them in place, the calling
+ * thread puts the chunks in order as they complete. Returns the number of
+ * bytes loaded, 0 on error.
+ */
+uint64_t FileLoader::transfer(const char* path, void* buffer, uint64_t size, bool put, int targetProcess, uint64_t targetOffset, RoceWin* win) {
+   int fd = open(path, O_RDONLY | O_DIRECT);
+   if (fd == -1 && errno == EINVAL) {
+      std::cerr << "O_DIRECT not supported for " << path << ", using buffered reads" << std::endl;
+      fd = open(path, O_RDONLY);
+   }
+   if (fd == -1) {
+      std::cerr << "[ERROR] on open " << path << std::endl;
+      return 0;
+   }
+
+   struct stat fileStat;
+   fstat(fd, &fileStat);
+   uint64_t length = fileStat.st_size;
+   if ((((uint64_t) buffer) % DIRECT_IO_ALIGNMENT) != 0 || size < bufferSize(length)) {
+      std::cerr << "[ERROR] buffer for " << path << " not aligned or smaller than " << bufferSize(length) << std::endl;
+      close(fd);
+      return 0;
+   }
+
+   uint64_t numChunks = (length + chunkSize - 1) / chunkSize;
+   std::unique_ptr<std::atomic<bool>[]> loaded(new std::atomic<bool>[numChunks]);
+   for (uint64_t i = 0; i < numChunks; ++i) {
+      loaded[i] = false;
+   }
+   std::atomic<uint64_t> nextChunk(0);
+   std::atomic<bool> failed(false);
+
+   std::vector<std::thread> readers;
+   for (uint32_t t = 0; t < numberOfReaders && t < numChunks; ++t) {
+      readers.emplace_back([&]() {
+         for (uint64_t chunk = nextChunk++; chunk < numChunks && !failed; chunk = nextChunk++) {
+            uint64_t offset = chunk * chunkSize;
+            uint64_t end = std::min(offset + chunkSize, bufferSize(length));
+            while (offset < end) {
+               ssize_t bytes = pread(fd, ((char*) buffer) + offset, end - offset, offset);
+               if (bytes < 0) {
+                  std::cerr << "[ERROR] on read of " << path << " at offset " << offset << std::endl;
+                  failed = true;
+                  break;
+               }
+               if (bytes == 0) {
+                  break;
+               }
+               offset += bytes;
+            }
+            loaded[chunk].store(true, std::memory_order_release);
+         }
+      });
+   }
+
+   for (uint64_t chunk = 0; chunk < numChunks && !failed; ++chunk) {
+      while (!loaded[chunk].load(std::memory_order_acquire) && !failed) {
+         std::this_thread::yield();
+      }
+      if (put && !failed) {
+         uint64_t offset = chunk * chunkSize;
+         communicator->put(buffer, std::min(chunkSize, length - offset), offset, targetProcess, targetOffset + offset, win);
+      }
+   }
+
+   for (std::thread& reader : readers) {
+      reader.join();
+   }
+   close(fd);
+   return failed ? 0 : length;
+}
+
+} /* namespace communication */
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef FILE_LOADER_H
+#define FILE_LOADER_H
+
+#include <stdint.h>
+
+#include <communication/HardRoceCommunicator.h>
+
+namespace communication {
+
+/*
+ * Streams a file into DMA memory with O_DIRECT reads of whole chunks, on
+ * several reader threads. With loadAndPut every chunk is put to the target
+ * as soon as it is loaded, so disk reads and network transfer overlap.
+ *
+ * The buffer has to be aligned to DIRECT_IO_ALIGNMENT and hold the file
+ * size rounded up to it, see bufferSize.
+ */
+class FileLoader {
+
+public:
+   FileLoader(HardRoceCommunicator* communicator, uint64_t chunkSize=CHUNK_SIZE, uint32_t numberOfReaders=NUM_READERS);
+
+   static uint64_t fileSize(const char* path);
+   static uint64_t bufferSize(uint64_t fileSize);
+
+   uint64_t load(const char* path, void* buffer, uint64_t size);
+   uint64_t loadAndPut(const char* path, void* buffer, uint64_t size, int targetProcess, uint64_t targetOffset, RoceWin* win);
+
+   static const uint64_t DIRECT_IO_ALIGNMENT = 4096;
+   static const uint64_t CHUNK_SIZE = 4*1024*1024;
+   static const uint32_t NUM_READERS = 4;
+
+private:
+   uint64_t transfer(const char* path, void* buffer, uint64_t size, bool put, int targetProcess, uint64_t targetOffset, RoceWin* win);
+
+   HardRoceCommunicator* communicator;
+   uint64_t              chunkSize;
+   uint32_t              numberOfReaders;
+
+};
+
+} /* namespace communication */
+
+#endif
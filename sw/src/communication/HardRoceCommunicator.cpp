@@ -12,6 +12,7 @@
 #include <fstream>
 #include <iomanip>
 #include <cstring>
+#include <algorithm>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netdb.h>
@@ -36,10 +37,15 @@ uint64_t* HardRoceCommunicator::reducedOutput = nullptr;
 //measurementMsg* HardRoceCommunicator::messages = nullptr;
 
 //TODO maybe pass FPGA object instead
-HardRoceCommunicator::HardRoceCommunicator(fpga::FpgaController* fpga, uint32_t nodeId, uint32_t numberOfNodes, uint32_t numberOfThreads, const char* masterIpAddress) {
+/*
+ * Every card of a node runs its own network stack, card d uses the
+ * addresses after baseIpAddr + d*MAX_NODES and its own exchange port
+ */
+HardRoceCommunicator::HardRoceCommunicator(fpga::FpgaController* fpga, uint32_t nodeId, uint32_t numberOfNodes, uint32_t numberOfThreads, const char* masterIpAddress, uint32_t device) {
    
-   port = 18515;
+   port = 18515 + device;
    ibPort = 0;
+   ipAddrBase = fpga::Configuration::baseIpAddr + device * fpga::Configuration::MAX_NODES;
    this->fpga = fpga;
 	this->nodeId = nodeId;
 	this->numberOfNodes = numberOfNodes;
@@ -49,6 +55,7 @@ HardRoceCommunicator::HardRoceCommunicator(fpga::FpgaController* fpga, uint32_t
    this->connections = new int[numberOfNodes];
    this->pairs = new roce::QueuePair[numberOfNodes];
    this->pushedLength = 0;
+   this->flushedLength = 0;
    this->totalExpected = 0;
    this->totalTuplesExpected = 0;
 
@@ -59,11 +66,21 @@ HardRoceCommunicator::HardRoceCommunicator(fpga::FpgaController* fpga, uint32_t
    initializeLocalQueues();
    //HJ_DEBUG("HardRoce", "HardRoce ready to connect");
 
-   uint32_t baseIpAddr = fpga::Configuration::BASE_IP_ADDR;
+   uint32_t baseIpAddr = ipAddrBase;
    fpga->setIpAddr(baseIpAddr + nodeId);
    fpga->setBoardNumber(nodeId);
    fpga->resetDmaReads();
    fpga->resetDmaWrites();
+#ifdef COMPLETION_QUEUE
+   cq = new fpga::CompletionQueue(fpga);
+   postedWrites = 0;
+   postedReads = 0;
+   completedWrites = 0;
+   completedReads = 0;
+   remoteWrites = 0;
+   expectedRemoteWrites = 0;
+   receivedLength = 0;
+#endif
    //fpga->resetPartitionTuples();
    
    int ret = 1;
@@ -98,6 +115,7 @@ HardRoceCommunicator::HardRoceCommunicator(fpga::FpgaController* fpga, uint32_t
 }
 
 HardRoceCommunicator::~HardRoceCommunicator() {
+   untrack();
 
    for (int i = 0; i < numberOfNodes; i++) {
       if (i == nodeId) {
@@ -108,6 +126,9 @@ HardRoceCommunicator::~HardRoceCommunicator() {
 
    delete[] connections;
    delete[] pairs;
+#ifdef COMPLETION_QUEUE
+   delete cq;
+#endif
 }
 
 void HardRoceCommunicator::connect() {
@@ -493,7 +514,7 @@ void HardRoceCommunicator::exchangeWindow(void* base, uint64_t size, RoceWin* wi
 
 }
 
-void HardRoceCommunicator::put(const void* originAddr, uint64_t originLength, uint64_t originOffset, int targetProcess, uint64_t targetOffset, RoceWin* win) {
+void HardRoceCommunicator::put(const void* originAddr, uint64_t originLength, uint64_t originOffset, int targetProcess, uint64_t targetOffset, RoceWin* win, uint32_t tag) {
    void* localAddr = (void*) (((char*) originAddr) + originOffset);
    void* remotAddr = (void*) (((char*) win->windows[targetProcess].base) + targetOffset);
    //Check if local Put
@@ -502,15 +523,36 @@ void HardRoceCommunicator::put(const void* originAddr, uint64_t originLength, ui
    } else {
       pushedLength += originLength;
       while (originLength > std::numeric_limits<uint32_t>::max()) {
-         fpga->postWrite(&(pairs[targetProcess]), localAddr, std::numeric_limits<uint32_t>::max(), remotAddr);
+#ifdef COMPLETION_QUEUE
+         postedWrites++;
+#endif
+         fpga->postWrite(&(pairs[targetProcess]), localAddr, std::numeric_limits<uint32_t>::max(), remotAddr, tag);
          localAddr = (void*) (((char*) localAddr) + std::numeric_limits<uint32_t>::max());
          originLength -= std::numeric_limits<uint32_t>::max();
       }
-      fpga->postWrite(&(pairs[targetProcess]), localAddr, (uint32_t) originLength, remotAddr);
+#ifdef COMPLETION_QUEUE
+      postedWrites++;
+#endif
+      fpga->postWrite(&(pairs[targetProcess]), localAddr, (uint32_t) originLength, remotAddr, tag);
    }
 }
 
-void HardRoceCommunicator::get(const void* originAddr, uint64_t originLength, uint64_t originOffset, int targetProcess, uint64_t targetOffset, RoceWin* win) {
+/*
+ * Records the put on the buffer, so that it is not reused before the FPGA
+ * has read it
+ */
+void HardRoceCommunicator::put(fpga::DmaBuffer& origin, uint64_t originLength, uint64_t originOffset, int targetProcess, uint64_t targetOffset, RoceWin* win) {
+   put(origin.data(), originLength, originOffset, targetProcess, targetOffset, win);
+   if (targetProcess != nodeId) {
+#ifdef COMPLETION_QUEUE
+      origin.addRead(this, postedWrites);
+#else
+      origin.addRead(this, pushedLength);
+#endif
+   }
+}
+
+void HardRoceCommunicator::get(const void* originAddr, uint64_t originLength, uint64_t originOffset, int targetProcess, uint64_t targetOffset, RoceWin* win, uint32_t tag) {
    void* localAddr = (void*) (((char*) originAddr) + originOffset);
    void* remotAddr = (void*) (((char*) win->windows[targetProcess].base) + targetOffset);
    //Check if local Get
@@ -518,15 +560,79 @@ void HardRoceCommunicator::get(const void* originAddr, uint64_t originLength, ui
       memcpy(localAddr, remotAddr, originLength);
    } else {
       while (originLength > std::numeric_limits<uint32_t>::max()) {
-         fpga->postRead(&(pairs[targetProcess]), localAddr, std::numeric_limits<uint32_t>::max(), remotAddr);
+#ifdef COMPLETION_QUEUE
+         postedReads++;
+#endif
+         fpga->postRead(&(pairs[targetProcess]), localAddr, std::numeric_limits<uint32_t>::max(), remotAddr, tag);
          localAddr = (void*) (((char*) localAddr) + std::numeric_limits<uint32_t>::max());
          originLength -= std::numeric_limits<uint32_t>::max();
       }
-      fpga->postRead(&(pairs[targetProcess]), localAddr, (uint32_t) originLength, remotAddr);
+#ifdef COMPLETION_QUEUE
+      postedReads++;
+#endif
+      fpga->postRead(&(pairs[targetProcess]), localAddr, (uint32_t) originLength, remotAddr, tag);
+   }
+}
+
+/*
+ * Converts the entries into descriptors cmdBatchMax at a time, so that each
+ * chunk is posted with a single fence
+ */
+void HardRoceCommunicator::putBatch(const RoceBatchEntry* entries, uint32_t count, int targetProcess, RoceWin* win) {
+   if (targetProcess == nodeId) {
+      for (uint32_t i = 0; i < count; ++i) {
+         put(entries[i].originAddr, entries[i].length, 0, targetProcess, entries[i].targetOffset, win);
+      }
+      return;
+   }
+   fpga::PostDescriptor descriptors[fpga::cmdBatchMax];
+   while (count > 0) {
+      uint32_t batch = std::min(count, fpga::cmdBatchMax);
+      uint64_t length = 0;
+      for (uint32_t i = 0; i < batch; ++i) {
+         descriptors[i] = {entries[i].originAddr, ((char*) win->windows[targetProcess].base) + entries[i].targetOffset, entries[i].length, entries[i].tag};
+         length += entries[i].length;
+      }
+      pushedLength += length;
+#ifdef COMPLETION_QUEUE
+      postedWrites += batch;
+#endif
+      fpga->postWriteBatch(&(pairs[targetProcess]), descriptors, batch);
+      entries += batch;
+      count -= batch;
+   }
+}
+
+void HardRoceCommunicator::getBatch(const RoceBatchEntry* entries, uint32_t count, int targetProcess, RoceWin* win) {
+   if (targetProcess == nodeId) {
+      for (uint32_t i = 0; i < count; ++i) {
+         get(entries[i].originAddr, entries[i].length, 0, targetProcess, entries[i].targetOffset, win);
+      }
+      return;
+   }
+   fpga::PostDescriptor descriptors[fpga::cmdBatchMax];
+   while (count > 0) {
+      uint32_t batch = std::min(count, fpga::cmdBatchMax);
+      for (uint32_t i = 0; i < batch; ++i) {
+         descriptors[i] = {entries[i].originAddr, ((char*) win->windows[targetProcess].base) + entries[i].targetOffset, entries[i].length, entries[i].tag};
+      }
+#ifdef COMPLETION_QUEUE
+      postedReads += batch;
+#endif
+      fpga->postReadBatch(&(pairs[targetProcess]), descriptors, batch);
+      entries += batch;
+      count -= batch;
    }
 }
 
 void HardRoceCommunicator::flushLocal() {
+#ifdef COMPLETION_QUEUE
+   fpga::Completion completion;
+   while (completedWrites < postedWrites) {
+      pollCompletion(completion);
+   }
+#else
+   uint64_t pushed = pushedLength;
    uint64_t flushed = fpga->getDmaReads();
    while(flushed != pushedLength) {
 #ifdef JOIN_DEBUG_PRINT
@@ -538,14 +644,41 @@ void HardRoceCommunicator::flushLocal() {
       std::this_thread::sleep_for(std::chrono::microseconds(1));
       flushed = fpga->getDmaReads();
    }
+   uint64_t current = flushedLength;
+   while (pushed > current && !flushedLength.compare_exchange_weak(current, pushed));
+#endif
+}
+
+/*
+ * With COMPLETION_QUEUE the LOCAL_WRITE completions count the payloads read.
+ * Without it the DMA_READS counter is shared by every communicator of the
+ * card and also counts reads that serve remote gets, so only a flushLocal
+ * of this communicator confirms its puts.
+ */
+uint64_t HardRoceCommunicator::readsCompleted(bool poll) {
+#ifdef COMPLETION_QUEUE
+   if (poll) {
+      fpga::Completion completion;
+      while (pollCompletion(completion));
+   }
+   return completedWrites;
+#else
+   return flushedLength;
+#endif
 }
 
 
 //Not thread safe
 void HardRoceCommunicator::checkWrites(uint64_t expected) {
 
-   uint64_t received = fpga->getDmaWrites();
    totalExpected += expected;
+#ifdef COMPLETION_QUEUE
+   fpga::Completion completion;
+   while (receivedLength < totalExpected) {
+      pollCompletion(completion);
+   }
+#else
+   uint64_t received = fpga->getDmaWrites();
    while (received < totalExpected) {
 #ifdef JOIN_DEBUG_PRINT
       printf("received: %lu, expected: %lu, totalExpected: %lu\n", received, expected, totalExpected);
@@ -556,6 +689,96 @@ void HardRoceCommunicator::checkWrites(uint64_t expected) {
       std::this_thread::sleep_for(std::chrono::microseconds(1));
       received = fpga->getDmaWrites();
    }
+#endif
+}
+
+/*
+ * Bytes written to this node by remote writes
+ */
+uint64_t HardRoceCommunicator::getReceivedLength() {
+#ifdef COMPLETION_QUEUE
+   fpga::Completion completion;
+   while (pollCompletion(completion));
+   return receivedLength;
+#else
+   return fpga->getDmaWrites();
+#endif
+}
+
+/*
+ * Completions are consumed by one thread at a time, a concurrent poll
+ * returns false. Every polled entry is also accounted for flushLocal,
+ * checkWrites, the wait functions and DmaBuffer reclamation.
+ */
+bool HardRoceCommunicator::pollCompletion(fpga::Completion& completion) {
+#ifdef COMPLETION_QUEUE
+   if (cqPolling.test_and_set(std::memory_order_acquire)) {
+      return false;
+   }
+   bool polled = cq->poll(completion);
+   if (polled) {
+      accountCompletion(completion);
+   }
+   cqPolling.clear(std::memory_order_release);
+   if (!polled) {
+      return false;
+   }
+   if (completion.status != 0) {
+      std::cerr << "[ERROR] completion of tag " << completion.tag << " failed with status " << (uint32_t) completion.status << std::endl;
+   }
+   return true;
+#else
+   return false;
+#endif
+}
+
+#ifdef COMPLETION_QUEUE
+void HardRoceCommunicator::accountCompletion(const fpga::Completion& completion) {
+   switch (completion.type) {
+   case fpga::completionType::LOCAL_WRITE:
+      completedWrites++;
+      break;
+   case fpga::completionType::LOCAL_READ:
+      completedReads++;
+      break;
+   case fpga::completionType::REMOTE_WRITE:
+      remoteWrites++;
+      receivedLength += completion.length;
+      break;
+   }
+}
+#endif
+
+/*
+ * Waits until all gets posted so far are in host memory
+ */
+void HardRoceCommunicator::waitForGets(const volatile uint64_t* lastWord) {
+#ifdef COMPLETION_QUEUE
+   (void) lastWord;
+   fpga::Completion completion;
+   while (completedReads < postedReads) {
+      pollCompletion(completion);
+   }
+#else
+   while (*lastWord == 0);
+#endif
+}
+
+/*
+ * Waits for count more incoming writes than waited for so far, without
+ * COMPLETION_QUEUE only for the one ending at lastWord
+ */
+void HardRoceCommunicator::waitForRemoteWrites(uint32_t count, const volatile uint64_t* lastWord) {
+#ifdef COMPLETION_QUEUE
+   (void) lastWord;
+   fpga::Completion completion;
+   expectedRemoteWrites += count;
+   while (remoteWrites < expectedRemoteWrites) {
+      pollCompletion(completion);
+   }
+#else
+   while (*lastWord == 0);
+#endif
 }
 
 static unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
@@ -566,7 +789,7 @@ void HardRoceCommunicator::initializeLocalQueues() {
    std::uniform_int_distribution<int> distr(0, std::numeric_limits<std::uint32_t>::max());
 
    //Assume IPv4
-   uint32_t ipAddr = fpga::Configuration::BASE_IP_ADDR;
+   uint32_t ipAddr = ipAddrBase;
    ipAddr += nodeId;
 
    for (int i = 0; i < numberOfNodes; ++i) {
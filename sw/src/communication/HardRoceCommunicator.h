@@ -15,6 +15,8 @@
 
 #include <communication/Communicator.h>
 #include <fpga/Configuration.h>
+#include <fpga/DmaBuffer.h>
+#include <fpga/CompletionQueue.h>
 //#include <core/HashJoinThread.h>
 //#include <communication/HardRoceWindow.h>
 #include <fpga/FpgaController.h>
@@ -36,6 +38,13 @@ struct RoceWinMeta {
 struct RoceWin {
    RoceWinMeta windows[fpga::Configuration::MAX_NODES];
 };
+
+struct RoceBatchEntry {
+   const void* originAddr;
+   uint64_t    targetOffset;
+   uint32_t    length;
+   uint32_t    tag;
+};
 //class HardRoceWindow;
 
 /*struct measurementMsg {
@@ -43,11 +52,11 @@ struct RoceWin {
    uint64_t thread;
 };*/
 
-class HardRoceCommunicator : public Communicator {
+class HardRoceCommunicator : public Communicator, public fpga::ReadTracker {
 
 public:
 
-	HardRoceCommunicator(fpga::FpgaController* fpga, uint32_t nodeId, uint32_t numberOfNodes, uint32_t numberOfThreads, const char* ipAddress);
+	HardRoceCommunicator(fpga::FpgaController* fpga, uint32_t nodeId, uint32_t numberOfNodes, uint32_t numberOfThreads, const char* ipAddress, uint32_t device=0);
 	virtual ~HardRoceCommunicator();
 
 public:
@@ -64,11 +73,22 @@ public:
 	void prefixSum(uint64_t *input, uint64_t *output, uint32_t numberOfElements, core::HashJoinThread* thread);
    void prefixSumThread(uint64_t *input, uint64_t *output, uint32_t numberOfElements, core::HashJoinThread* thread);*/
 
-   void put(const void* originAddr, uint64_t originLength, uint64_t originOffset, int targetProcess, uint64_t targetOffset, communication::RoceWin *win);
-   void get(const void* originAddr, uint64_t originLength, uint64_t originOffset, int targetProcess, uint64_t targetOffset, communication::RoceWin *win);
+   void put(const void* originAddr, uint64_t originLength, uint64_t originOffset, int targetProcess, uint64_t targetOffset, communication::RoceWin *win, uint32_t tag=0);
+   void get(const void* originAddr, uint64_t originLength, uint64_t originOffset, int targetProcess, uint64_t targetOffset, communication::RoceWin *win, uint32_t tag=0);
+   void put(fpga::DmaBuffer& origin, uint64_t originLength, uint64_t originOffset, int targetProcess, uint64_t targetOffset, communication::RoceWin *win);
+   void putBatch(const RoceBatchEntry* entries, uint32_t count, int targetProcess, communication::RoceWin *win);
+   void getBatch(const RoceBatchEntry* entries, uint32_t count, int targetProcess, communication::RoceWin *win);
 
    void flushLocal();
+   //Puts of DmaBuffers whose payload has been read, counted in posted writes with COMPLETION_QUEUE and in bytes up to the last flushLocal otherwise
+   uint64_t readsCompleted(bool poll) override;
    void checkWrites(uint64_t expected);
+   uint64_t getReceivedLength();
+
+   //Completions, without COMPLETION_QUEUE the last word of the data is polled and has to be non-zero
+   bool pollCompletion(fpga::Completion& completion);
+   void waitForGets(const volatile uint64_t* lastWord);
+   void waitForRemoteWrites(uint32_t count, const volatile uint64_t* lastWord);
 
 protected:
 
@@ -97,9 +117,24 @@ protected:
    int*  connections;
    uint16_t port;
    uint16_t ibPort;
+   uint32_t ipAddrBase;
    roce::QueuePair*   pairs;
    std::atomic<uint64_t> pushedLength;
+   std::atomic<uint64_t> flushedLength;
    uint64_t totalExpected;
+#ifdef COMPLETION_QUEUE
+   void accountCompletion(const fpga::Completion& completion);
+
+   fpga::CompletionQueue* cq;
+   std::atomic_flag cqPolling = ATOMIC_FLAG_INIT;
+   std::atomic<uint64_t> postedWrites;
+   std::atomic<uint64_t> postedReads;
+   std::atomic<uint64_t> completedWrites;
+   uint64_t completedReads;
+   uint64_t remoteWrites;
+   uint64_t expectedRemoteWrites;
+   uint64_t receivedLength;
+#endif
    uint64_t totalTuplesExpected;
 	//uint16_t *portNumbers;
 
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "StripedCommunicator.h"
+
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+#include <fpga/Fpga.h>
+
+namespace communication {
+
+StripedCommunicator::StripedCommunicator(uint32_t nodeId, uint32_t numberOfNodes, uint32_t numberOfThreads, const char* masterIpAddress) {
+   this->nodeId = nodeId;
+   this->numberOfNodes = numberOfNodes;
+   this->numberOfThreads = numberOfThreads;
+   this->totalExpected = 0;
+
+   //Cards connect one after the other, in the same order on every node
+   for (uint32_t d = 0; d < fpga::Fpga::getNumberOfDevices(); ++d) {
+      communicators.push_back(new HardRoceCommunicator(fpga::Fpga::getController(d), nodeId, numberOfNodes, numberOfThreads, masterIpAddress, d));
+   }
+}
+
+StripedCommunicator::~StripedCommunicator() {
+   for (HardRoceCommunicator* communicator : communicators) {
+      delete communicator;
+   }
+}
+
+void StripedCommunicator::connect() {
+   for (HardRoceCommunicator* communicator : communicators) {
+      communicator->connect();
+   }
+}
+
+void StripedCommunicator::prepare() {
+   for (HardRoceCommunicator* communicator : communicators) {
+      communicator->prepare();
+   }
+}
+
+/*
+ * Length of the stripe of every card but the last one, which takes the
+ * remainder. Zero if the transfer is not striped.
+ */
+uint64_t StripedCommunicator::stripeSize(uint64_t length) {
+   uint64_t numberOfStripes = communicators.size();
+   if (numberOfStripes < 2 || length < fpga::Configuration::STRIPE_MIN_SIZE) {
+      return 0;
+   }
+   uint64_t stripe = (length + numberOfStripes - 1) / numberOfStripes;
+   stripe = (stripe + fpga::Configuration::STRIPE_ALIGNMENT - 1) & ~(fpga::Configuration::STRIPE_ALIGNMENT - 1);
+   return stripe;
+}
+
+void StripedCommunicator::put(const void* originAddr, uint64_t originLength, uint64_t originOffset, int targetProcess, uint64_t targetOffset, RoceWin* win) {
+   uint64_t stripe = stripeSize(originLength);
+   if (stripe == 0 || targetProcess == nodeId) {
+      communicators[0]->put(originAddr, originLength, originOffset, targetProcess, targetOffset, win);
+      return;
+   }
+   uint64_t done = 0;
+   for (uint32_t d = 0; d < communicators.size() && done < originLength; ++d) {
+      uint64_t length = std::min(stripe, originLength - done);
+      communicators[d]->put(originAddr, length, originOffset + done, targetProcess, targetOffset + done, win);
+      done += length;
+   }
+}
+
+void StripedCommunicator::get(const void* originAddr, uint64_t originLength, uint64_t originOffset, int targetProcess, uint64_t targetOffset, RoceWin* win) {
+   uint64_t stripe = stripeSize(originLength);
+   if (stripe == 0 || targetProcess == nodeId) {
+      communicators[0]->get(originAddr, originLength, originOffset, targetProcess, targetOffset, win);
+      return;
+   }
+   uint64_t done = 0;
+   for (uint32_t d = 0; d < communicators.size() && done < originLength; ++d) {
+      uint64_t length = std::min(stripe, originLength - done);
+      communicators[d]->get(originAddr, length, originOffset + done, targetProcess, targetOffset + done, win);
+      done += length;
+   }
+}
+
+void StripedCommunicator::flushLocal() {
+   for (HardRoceCommunicator* communicator : communicators) {
+      communicator->flushLocal();
+   }
+}
+
+/*
+ * Waits for the bytes written by all cards together, the split between the
+ * cards depends on the sizes the remote side used. Not thread safe.
+ */
+void StripedCommunicator::checkWrites(uint64_t expected) {
+   totalExpected += expected;
+   while (true) {
+      uint64_t received = 0;
+      for (HardRoceCommunicator* communicator : communicators) {
+         received += communicator->getReceivedLength();
+      }
+      if (received >= totalExpected) {
+         break;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(1));
+   }
+}
+
+void StripedCommunicator::exchangeWindow(void* base, uint64_t size, RoceWin* win) {
+   communicators[0]->exchangeWindow(base, size, win);
+}
+
+} /* namespace communication */
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef STRIPED_COMMUNICATOR_H
+#define STRIPED_COMMUNICATOR_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <communication/HardRoceCommunicator.h>
+
+namespace communication {
+
+/*
+ * Spreads transfers over all FPGAs of a node. Every card gets its own
+ * HardRoceCommunicator, transfers of at least STRIPE_MIN_SIZE are split into
+ * one contiguous stripe per card, smaller ones use card 0 so that their
+ * order is kept.
+ *
+ * Stripes complete independently, the last bytes of a striped put can arrive
+ * before its first ones. Completion has to be checked with flushLocal and
+ * checkWrites instead of polling the end of the target buffer.
+ *
+ * Requires the DMA region to be mapped on all cards, see
+ * Fpga::setNumberOfDevices. Windows are exchanged once, the remote region is
+ * at the same address on every remote card.
+ */
+class StripedCommunicator : public Communicator {
+
+public:
+   StripedCommunicator(uint32_t nodeId, uint32_t numberOfNodes, uint32_t numberOfThreads, const char* masterIpAddress);
+   virtual ~StripedCommunicator();
+
+   void connect();
+   void prepare();
+
+   void put(const void* originAddr, uint64_t originLength, uint64_t originOffset, int targetProcess, uint64_t targetOffset, RoceWin* win);
+   void get(const void* originAddr, uint64_t originLength, uint64_t originOffset, int targetProcess, uint64_t targetOffset, RoceWin* win);
+
+   void flushLocal();
+   void checkWrites(uint64_t expected);
+   void exchangeWindow(void* base, uint64_t size, RoceWin* win);
+
+   uint32_t getNumberOfDevices() { return communicators.size(); }
+   HardRoceCommunicator* getCommunicator(uint32_t device) { return communicators[device]; }
+
+private:
+   uint64_t stripeSize(uint64_t length);
+
+   std::vector<HardRoceCommunicator*> communicators;
+   uint64_t                           totalExpected;
+
+};
+
+} /* namespace communication */
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "CompletionQueue.h"
+
+#include <iostream>
+
+#include <fpga/Fpga.h>
+#include <fpga/FpgaController.h>
+
+namespace fpga {
+
+/*
+ * The ring is zeroed, so the hardware starts with phase 1
+ */
+CompletionQueue::CompletionQueue(FpgaController* controller, uint32_t numEntries)
+   :controller(controller), ring(nullptr), mask(0), head(0), phase(1)
+{
+   if (numEntries < 4 || (numEntries & (numEntries - 1)) != 0) {
+      std::cerr << "[ERROR] completion queue entries have to be a power of two, at least 4" << std::endl;
+      numEntries = cqDefaultEntries;
+   }
+   mask = numEntries - 1;
+   ring = (volatile Completion*) Fpga::allocate(numEntries * sizeof(Completion), true, 4096);
+   controller->setCompletionQueue((void*) ring, numEntries);
+}
+
+CompletionQueue::~CompletionQueue()
+{
+   controller->setCompletionQueue(nullptr, 0);
+   Fpga::free((void*) ring);
+}
+
+uint32_t CompletionQueue::poll(Completion* completions, uint32_t maxCompletions)
+{
+   uint32_t count = 0;
+   while (count < maxCompletions && poll(completions[count])) {
+      count++;
+   }
+   return count;
+}
+
+void CompletionQueue::advance()
+{
+   head++;
+   if ((head & mask) == 0) {
+      phase ^= 1;
+   }
+   if ((head & (mask >> 2)) == 0) {
+      controller->writeCqHead(head);
+   }
+}
+
+} /* namespace fpga */
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef COMPLETION_QUEUE_H
+#define COMPLETION_QUEUE_H
+
+#include <cstdint>
+
+namespace fpga {
+
+class FpgaController;
+
+enum class completionType : uint8_t { LOCAL_WRITE=0, LOCAL_READ=1, REMOTE_WRITE=2 };
+
+/*
+ * Entry written by the hardware. LOCAL_WRITE once the payload of a posted
+ * write has been read from host memory, LOCAL_READ once the data of a read
+ * is in host memory, REMOTE_WRITE once an incoming write message is in host
+ * memory. The phase is written last and flips with every pass over the ring.
+ */
+struct Completion {
+   uint32_t tag;
+   uint32_t length;
+   uint16_t qpn;
+   completionType type;
+   uint8_t  status; //0 on success
+   uint32_t phase;
+};
+
+static const uint32_t cqDefaultEntries = 4096;
+
+/*
+ * Ring of completions in the DMA region, registered with one card. It has
+ * a single consumer, the head is handed back to the hardware every quarter
+ * of the ring to free the slots.
+ */
+class CompletionQueue {
+
+public:
+   CompletionQueue(FpgaController* controller, uint32_t numEntries=cqDefaultEntries);
+   ~CompletionQueue();
+
+   CompletionQueue(CompletionQueue const&)   = delete;
+   void operator =(CompletionQueue const&)   = delete;
+
+   bool poll(Completion& completion) {
+      volatile Completion* entry = ring + (head & mask);
+      if (entry->phase != phase) {
+         return false;
+      }
+      completion.tag = entry->tag;
+      completion.length = entry->length;
+      completion.qpn = entry->qpn;
+      completion.type = entry->type;
+      completion.status = entry->status;
+      completion.phase = phase;
+      advance();
+      return true;
+   }
+   uint32_t poll(Completion* completions, uint32_t maxCompletions);
+
+   uint32_t getNumberOfEntries() const { return mask + 1; }
+
+private:
+   void advance();
+
+   FpgaController*      controller;
+   volatile Completion* ring;
+   uint32_t             mask;
+   uint32_t             head;
+   uint32_t             phase;
+};
+
+} /* namespace fpga */
+
+#endif
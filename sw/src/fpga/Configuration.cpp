@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "Configuration.h"
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+namespace fpga {
+
+std::string Configuration::hugePath = "/media/huge/abc";
+uint64_t Configuration::hugePageSize = HUGE_PAGE_SIZE;
+uint64_t Configuration::initialDmaSize = INITIAL_DMA_SIZE;
+uint64_t Configuration::growthDmaSize = GROWTH_HUGE_PAGES*HUGE_PAGE_SIZE;
+uint64_t Configuration::maxDmaSize = MAX_DMA_SIZE;
+uint32_t Configuration::populateThreads = POPULATE_THREADS;
+uint64_t Configuration::populatePartSize = POPULATE_PART_PAGES*HUGE_PAGE_SIZE;
+uint32_t Configuration::baseIpAddr = BASE_IP_ADDR;
+bool Configuration::loaded = false;
+
+static const char* KEYS[] = {"huge_path", "huge_page_size", "huge_pages", "growth_huge_pages", "max_huge_pages",
+                             "populate_threads", "populate_part_pages", "base_ip_addr"};
+
+static std::string trim(const std::string& value) {
+   size_t first = value.find_first_not_of(" \t\r");
+   if (first == std::string::npos) {
+      return "";
+   }
+   size_t last = value.find_last_not_of(" \t\r");
+   return value.substr(first, last - first + 1);
+}
+
+//Number with an optional K, M or G suffix
+static bool parseSize(const std::string& value, uint64_t& size) {
+   char* end = nullptr;
+   uint64_t number = strtoull(value.c_str(), &end, 0);
+   if (end == value.c_str()) {
+      return false;
+   }
+   switch (toupper(*end)) {
+      case 'G': number *= 1024; //fall through
+      case 'M': number *= 1024; //fall through
+      case 'K': number *= 1024; ++end;
+      default: break;
+   }
+   if (*end != '\0' && toupper(*end) != 'B' && toupper(*end) != 'I') {
+      return false;
+   }
+   size = number;
+   return true;
+}
+
+//Dotted IPv4 address or number
+static bool parseIpAddr(const std::string& value, uint32_t& addr) {
+   struct in_addr parsed;
+   if (inet_pton(AF_INET, value.c_str(), &parsed) == 1) {
+      addr = ntohl(parsed.s_addr);
+      return true;
+   }
+   uint64_t number;
+   if (parseSize(value, number) && number <= 0xFFFFFFFF) {
+      addr = number;
+      return true;
+   }
+   return false;
+}
+
+/*
+ * Reads "key = value" lines from path, or from the file in DAVOS_CONFIG if
+ * path is null. The environment variable DAVOS_<KEY> overrides key. Counts
+ * of huge pages are in pages of huge_page_size.
+ *
+ *   huge_path            hugetlbfs file backing the DMA region, suffixed with the pid
+ *   huge_page_size       2M or 1G
+ *   huge_pages           pages mapped at startup
+ *   growth_huge_pages    pages added when the memory manager runs out
+ *   max_huge_pages       upper limit, at most MAX_DMA_SIZE
+ *   populate_threads     threads faulting in pages at startup
+ *   populate_part_pages  2 MiB pages pinned per ioctl at startup
+ *   base_ip_addr         IP of node 0 on card 0, e.g. 11.1.212.209
+ *
+ * Nothing is changed if a value is invalid.
+ */
+bool Configuration::load(const char* path) {
+   std::map<std::string, std::string> values;
+
+   if (path == nullptr) {
+      path = getenv("DAVOS_CONFIG");
+   }
+   if (path != nullptr) {
+      std::ifstream file(path);
+      if (!file) {
+         std::cerr << "[ERROR] could not open configuration " << path << std::endl;
+         return false;
+      }
+      std::string line;
+      while (std::getline(file, line)) {
+         line = trim(line.substr(0, line.find('#')));
+         if (line.empty()) {
+            continue;
+         }
+         size_t separator = line.find('=');
+         if (separator == std::string::npos) {
+            std::cerr << "[ERROR] invalid configuration line: " << line << std::endl;
+            return false;
+         }
+         values[trim(line.substr(0, separator))] = trim(line.substr(separator + 1));
+      }
+   }
+   for (const char* key : KEYS) {
+      std::string variable = "DAVOS_" + std::string(key);
+      std::transform(variable.begin(), variable.end(), variable.begin(), ::toupper);
+      const char* value = getenv(variable.c_str());
+      if (value != nullptr) {
+         values[key] = value;
+      }
+   }
+
+   //Unset keys keep their defaults, counts are converted to the page size below
+   std::string newHugePath = "/media/huge/abc";
+   uint64_t newHugePageSize = HUGE_PAGE_SIZE;
+   uint64_t initialPages = 0;
+   uint64_t growthPages = 0;
+   uint64_t maxPages = 0;
+   uint64_t threads = POPULATE_THREADS;
+   uint64_t partPages = POPULATE_PART_PAGES;
+   uint32_t newBaseIpAddr = BASE_IP_ADDR;
+
+   for (auto& entry : values) {
+      const std::string& key = entry.first;
+      const std::string& value = entry.second;
+      bool valid = true;
+      if (key == "huge_path") {
+         newHugePath = value;
+         valid = !value.empty();
+      } else if (key == "huge_page_size") {
+         valid = parseSize(value, newHugePageSize);
+      } else if (key == "huge_pages") {
+         valid = parseSize(value, initialPages) && initialPages > 0;
+      } else if (key == "growth_huge_pages") {
+         valid = parseSize(value, growthPages) && growthPages > 0;
+      } else if (key == "max_huge_pages") {
+         valid = parseSize(value, maxPages) && maxPages > 0;
+      } else if (key == "populate_threads") {
+         valid = parseSize(value, threads) && threads > 0;
+      } else if (key == "populate_part_pages") {
+         valid = parseSize(value, partPages) && partPages > 0;
+      } else if (key == "base_ip_addr") {
+         valid = parseIpAddr(value, newBaseIpAddr);
+      } else {
+         std::cerr << "[ERROR] unknown configuration key: " << key << std::endl;
+         return false;
+      }
+      if (!valid) {
+         std::cerr << "[ERROR] invalid value for " << key << ": " << value << std::endl;
+         return false;
+      }
+   }
+
+   if (newHugePageSize != HUGE_PAGE_SIZE && newHugePageSize != GIGANTIC_PAGE_SIZE) {
+      std::cerr << "[ERROR] huge page size has to be 2M or 1G" << std::endl;
+      return false;
+   }
+   //Default sizes stay the same with larger pages
+   if (initialPages == 0) {
+      initialPages = std::max<uint64_t>(1, INITIAL_DMA_SIZE / newHugePageSize);
+   }
+   if (growthPages == 0) {
+      growthPages = std::max<uint64_t>(1, (GROWTH_HUGE_PAGES * HUGE_PAGE_SIZE) / newHugePageSize);
+   }
+   if (maxPages == 0) {
+      maxPages = MAX_DMA_SIZE / newHugePageSize;
+   }
+   if (maxPages > MAX_DMA_SIZE / newHugePageSize) {
+      std::cerr << "[ERROR] the TLB maps at most " << (MAX_DMA_SIZE / newHugePageSize) << " huge pages" << std::endl;
+      return false;
+   }
+   if (initialPages > maxPages) {
+      std::cerr << "[ERROR] invalid number of huge pages: " << initialPages << " initial, " << growthPages << " growth, " << maxPages << " max" << std::endl;
+      return false;
+   }
+
+   hugePath = newHugePath;
+   hugePageSize = newHugePageSize;
+   initialDmaSize = initialPages * hugePageSize;
+   growthDmaSize = growthPages * hugePageSize;
+   maxDmaSize = maxPages * hugePageSize;
+   populateThreads = threads;
+   //Parts are populated and pinned in whole pages
+   populatePartSize = ((partPages * HUGE_PAGE_SIZE + hugePageSize - 1) / hugePageSize) * hugePageSize;
+   baseIpAddr = newBaseIpAddr;
+   loaded = true;
+   return true;
+}
+
+void Configuration::print() {
+   struct in_addr addr;
+   addr.s_addr = htonl(baseIpAddr);
+   std::cout << "------------ CONFIGURATION ---------------" << std::endl;
+   std::cout << "huge path: " << hugePath << std::endl;
+   std::cout << "huge page size: " << hugePageSize << std::endl;
+   std::cout << "initial dma size: " << initialDmaSize << std::endl;
+   std::cout << "growth dma size: " << growthDmaSize << std::endl;
+   std::cout << "max dma size: " << maxDmaSize << std::endl;
+   std::cout << "populate threads: " << populateThreads << ", part size: " << populatePartSize << std::endl;
+   std::cout << "base ip address: " << inet_ntoa(addr) << std::endl;
+   std::cout << "----------------------------------" << std::endl;
+}
+
+} /* namespace fpga */
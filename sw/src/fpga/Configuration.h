@@ -29,6 +29,7 @@
 #define FPGA_CONFIGURATION_H_
 
 #include <stdint.h>
+#include <string>
 
 namespace fpga {
 
@@ -37,12 +38,42 @@ class Configuration {
 public:
 
    /** FPGA related parameters **/
-   static const uint64_t HUGE_PAGE_SIZE = 2*1024*1024;
-   static const uint64_t NUM_HUGE_PAGES = 2048;
-   static const uint64_t DMA_SIZE = NUM_HUGE_PAGES*HUGE_PAGE_SIZE;
+   static const uint64_t HUGE_PAGE_SIZE = 2*1024*1024; //Page size of the TLB
+   static const uint64_t GIGANTIC_PAGE_SIZE = 1024*1024*1024; //Only other huge_page_size accepted
+   static const uint64_t INITIAL_HUGE_PAGES = 256;
+   static const uint64_t GROWTH_HUGE_PAGES = 256;
+   static const uint64_t MAX_HUGE_PAGES = 16384; //TLB entries
+   static const uint64_t INITIAL_DMA_SIZE = INITIAL_HUGE_PAGES*HUGE_PAGE_SIZE;
+   static const uint64_t MAX_DMA_SIZE = MAX_HUGE_PAGES*HUGE_PAGE_SIZE;
+   static const uint32_t POPULATE_THREADS = 8;
+   static const uint64_t POPULATE_PART_PAGES = 32; //Huge pages pinned per ioctl during startup
    static const uint32_t IP_VERSION = 4;
    static const uint32_t MAX_NODES = 8;
    static const uint32_t BASE_IP_ADDR = 0x0B01D4D1;
+   static const uint32_t MAX_DEVICES = 4; //FPGAs per host, card d uses the IPs after baseIpAddr + d*MAX_NODES
+   static const uint64_t STRIPE_MIN_SIZE = 1024*1024; //Smaller transfers are not striped across cards
+   static const uint64_t STRIPE_ALIGNMENT = 4096;
+
+   /*
+    * Runtime parameters of the DMA region and the network, the constants
+    * above are their defaults and limits. Set by load from a file and
+    * environment variables, see load.
+    */
+   static std::string hugePath;
+   static uint64_t    hugePageSize; //2 MiB or 1 GiB pages of the hugetlbfs mount
+   static uint64_t    initialDmaSize;
+   static uint64_t    growthDmaSize;
+   static uint64_t    maxDmaSize;
+   static uint32_t    populateThreads;
+   static uint64_t    populatePartSize;
+   static uint32_t    baseIpAddr;
+
+   static bool load(const char* path=nullptr);
+   static bool isLoaded() { return loaded; }
+   static void print();
+
+private:
+   static bool loaded;
 
 };
 
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "CounterSampler.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace fpga {
+
+//Positions in DmaRegNames and NetRegNames
+static const uint32_t dmaWriteWordsReg = 1;
+static const uint32_t dmaReadWordsReg = 5;
+static const uint32_t tlbMissReg = 8;
+static const uint32_t crcDropsReg = 0;
+static const uint32_t psnDropsReg = 1;
+static const uint32_t roceRxPacketsReg = 16;
+static const uint32_t roceTxPacketsReg = 17;
+
+/*
+ * The unsigned difference stays correct across one wrap of a counter
+ */
+CounterRates computeRates(const CounterSnapshot& previous, const CounterSnapshot& current)
+{
+   CounterRates rates;
+   rates.seconds = std::chrono::duration_cast<std::chrono::microseconds>(current.time - previous.time).count() / 1000.0 / 1000.0;
+   double scale = (rates.seconds > 0.0) ? (1.0 / rates.seconds) : 0.0;
+   rates.dmaWriteWords = (uint32_t) (current.dma[dmaWriteWordsReg] - previous.dma[dmaWriteWordsReg]) * scale;
+   rates.dmaReadWords = (uint32_t) (current.dma[dmaReadWordsReg] - previous.dma[dmaReadWordsReg]) * scale;
+   rates.tlbMisses = (uint32_t) (current.dma[tlbMissReg] - previous.dma[tlbMissReg]) * scale;
+   rates.crcDrops = (uint32_t) (current.net[crcDropsReg] - previous.net[crcDropsReg]) * scale;
+   rates.psnDrops = (uint32_t) (current.net[psnDropsReg] - previous.net[psnDropsReg]) * scale;
+   rates.roceRxPackets = (uint32_t) (current.net[roceRxPacketsReg] - previous.net[roceRxPacketsReg]) * scale;
+   rates.roceTxPackets = (uint32_t) (current.net[roceTxPacketsReg] - previous.net[roceTxPacketsReg]) * scale;
+   return rates;
+}
+
+CounterSampler::CounterSampler(FpgaController* controller, const std::string& path, uint32_t intervalMs, uint8_t port)
+   :controller(controller), path(path), isJson(false), intervalMs(intervalMs), port(port), running(false), rates()
+{
+   std::string suffix = ".json";
+   isJson = (path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0);
+   if (this->intervalMs == 0) {
+      std::cerr << "[ERROR] counter sampling interval has to be at least 1 ms" << std::endl;
+      this->intervalMs = 1000;
+   }
+}
+
+CounterSampler::~CounterSampler()
+{
+   stop();
+}
+
+void CounterSampler::start()
+{
+   std::lock_guard<std::mutex> guard(mutex);
+   if (running) {
+      return;
+   }
+   snapshot = controller->readCounters(port);
+   running = true;
+   sampler = std::thread(&CounterSampler::run, this);
+}
+
+void CounterSampler::stop()
+{
+   {
+      std::lock_guard<std::mutex> guard(mutex);
+      if (!running) {
+         return;
+      }
+      running = false;
+   }
+   stopped.notify_all();
+   sampler.join();
+}
+
+CounterRates CounterSampler::getRates()
+{
+   std::lock_guard<std::mutex> guard(mutex);
+   return rates;
+}
+
+CounterSnapshot CounterSampler::getSnapshot()
+{
+   std::lock_guard<std::mutex> guard(mutex);
+   return snapshot;
+}
+
+void CounterSampler::run()
+{
+   std::unique_lock<std::mutex> guard(mutex);
+   while (!stopped.wait_for(guard, std::chrono::milliseconds(intervalMs), [this]{ return !running; })) {
+      CounterSnapshot previous = snapshot;
+      guard.unlock();
+      CounterSnapshot current = controller->readCounters(port);
+      CounterRates currentRates = computeRates(previous, current);
+      if (!path.empty()) {
+         exportRates(currentRates);
+      }
+      guard.lock();
+      snapshot = current;
+      rates = currentRates;
+   }
+}
+
+void CounterSampler::exportRates(const CounterRates& rates)
+{
+   std::string tmpPath = path + ".tmp";
+   std::ofstream out(tmpPath, std::ios::trunc);
+   if (!out) {
+      std::cerr << "[ERROR] could not write counters to " << tmpPath << std::endl;
+      return;
+   }
+   uint64_t timeMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+   if (isJson) {
+      out << "{\"time_ms\": " << timeMs
+          << ", \"interval_s\": " << rates.seconds
+          << ", \"dma_write_words_per_s\": " << rates.dmaWriteWords
+          << ", \"dma_read_words_per_s\": " << rates.dmaReadWords
+          << ", \"roce_rx_packets_per_s\": " << rates.roceRxPackets
+          << ", \"roce_tx_packets_per_s\": " << rates.roceTxPackets
+          << ", \"crc_drops_per_s\": " << rates.crcDrops
+          << ", \"psn_drops_per_s\": " << rates.psnDrops
+          << ", \"tlb_misses_per_s\": " << rates.tlbMisses
+          << "}" << std::endl;
+   } else {
+      out << "time_ms " << timeMs << std::endl;
+      out << "interval_s " << rates.seconds << std::endl;
+      out << "dma_write_words_per_s " << rates.dmaWriteWords << std::endl;
+      out << "dma_read_words_per_s " << rates.dmaReadWords << std::endl;
+      out << "roce_rx_packets_per_s " << rates.roceRxPackets << std::endl;
+      out << "roce_tx_packets_per_s " << rates.roceTxPackets << std::endl;
+      out << "crc_drops_per_s " << rates.crcDrops << std::endl;
+      out << "psn_drops_per_s " << rates.psnDrops << std::endl;
+      out << "tlb_misses_per_s " << rates.tlbMisses << std::endl;
+   }
+   out.close();
+   if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+      std::cerr << "[ERROR] could not replace " << path << std::endl;
+   }
+}
+
+} /* namespace fpga */
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef COUNTER_SAMPLER_H
+#define COUNTER_SAMPLER_H
+
+#include <cstdint>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+
+#include <fpga/FpgaController.h>
+
+namespace fpga {
+
+//Per-second rates between two snapshots
+struct CounterRates {
+   double seconds;
+   double dmaWriteWords;
+   double dmaReadWords;
+   double roceRxPackets;
+   double roceTxPackets;
+   double crcDrops;
+   double psnDrops;
+   double tlbMisses;
+};
+
+CounterRates computeRates(const CounterSnapshot& previous, const CounterSnapshot& current);
+
+/*
+ * Background thread that snapshots the counters of one card every interval
+ * and keeps the latest rates. If a path is given the rates are also written
+ * there on every sample, as JSON if it ends in .json and as text otherwise.
+ * The file is replaced atomically, so it can be watched while it is written.
+ */
+class CounterSampler {
+
+public:
+   CounterSampler(FpgaController* controller, const std::string& path="", uint32_t intervalMs=1000, uint8_t port=0);
+   ~CounterSampler();
+
+   CounterSampler(CounterSampler const&)   = delete;
+   void operator =(CounterSampler const&)  = delete;
+
+   void start();
+   void stop();
+   CounterRates getRates();
+   CounterSnapshot getSnapshot();
+
+private:
+   void run();
+   void exportRates(const CounterRates& rates);
+
+   FpgaController*         controller;
+   std::string             path;
+   bool                    isJson;
+   uint32_t                intervalMs;
+   uint8_t                 port;
+
+   std::thread             sampler;
+   std::mutex              mutex;
+   std::condition_variable stopped;
+   bool                    running;
+   CounterSnapshot         snapshot;
+   CounterRates            rates;
+};
+
+} /* namespace fpga */
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef DMA_ALLOCATOR_H
+#define DMA_ALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include <fpga/Fpga.h>
+
+namespace fpga {
+
+/*
+ * Standard allocator handing out memory of the pinned DMA region, so that
+ * the data of containers such as std::vector can be passed to put/get
+ * without a copy. Memory is not zeroed, containers initialize it themselves.
+ */
+template <class T>
+class DmaAllocator {
+
+public:
+   typedef T value_type;
+
+   DmaAllocator(uint8_t tag=0) noexcept : tag(tag) {}
+   template <class U>
+   DmaAllocator(const DmaAllocator<U>& other) noexcept : tag(other.tag) {}
+
+   T* allocate(std::size_t n) {
+      void* ptr = Fpga::allocate(n * sizeof(T), false, alignof(T) > 64 ? alignof(T) : 0, tag);
+      if (ptr == nullptr) {
+         throw std::bad_alloc();
+      }
+      return (T*) ptr;
+   }
+
+   void deallocate(T* ptr, std::size_t) noexcept {
+      Fpga::free(ptr);
+   }
+
+   //Memory from any instance can be freed by any other
+   template <class U>
+   bool operator==(const DmaAllocator<U>&) const noexcept { return true; }
+   template <class U>
+   bool operator!=(const DmaAllocator<U>&) const noexcept { return false; }
+
+   uint8_t tag;
+
+};
+
+} /* namespace fpga */
+
+#endif
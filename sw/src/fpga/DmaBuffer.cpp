@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "DmaBuffer.h"
+#include "Fpga.h"
+
+#include <chrono>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace fpga {
+
+static const uint32_t drainTimeoutMs = 1000;
+
+//Retired chunks with the reads that still have to complete
+struct RetiredChunk {
+   void* ptr;
+   std::vector<PendingRead> reads;
+};
+static std::mutex retiredMutex;
+static std::list<RetiredChunk> retired;
+
+//Held while a tracker is asked for completions, so that it cannot go away meanwhile
+static std::mutex trackerMutex;
+static std::set<ReadTracker*> trackers;
+
+ReadTracker::ReadTracker()
+{
+   std::lock_guard<std::mutex> guard(trackerMutex);
+   trackers.insert(this);
+}
+
+ReadTracker::~ReadTracker()
+{
+   untrack();
+}
+
+void ReadTracker::untrack()
+{
+   std::lock_guard<std::mutex> guard(trackerMutex);
+   trackers.erase(this);
+}
+
+DmaBuffer::DmaBuffer()
+   :ptr(nullptr), length(0), operations(0)
+{
+}
+
+DmaBuffer::DmaBuffer(uint64_t size, bool zero)
+   :ptr(nullptr), length(size), operations(0)
+{
+   reclaim();
+   ptr = Fpga::allocate(size, zero);
+   if (ptr == nullptr) {
+      //Retired memory might be enough once the FPGA is done with it
+      drain();
+      ptr = Fpga::allocate(size, zero);
+   }
+   if (ptr == nullptr) {
+      length = 0;
+   }
+}
+
+DmaBuffer::DmaBuffer(DmaBuffer&& other)
+   :ptr(other.ptr), length(other.length), reads(std::move(other.reads)), operations(other.operations)
+{
+   other.ptr = nullptr;
+   other.length = 0;
+   other.reads.clear();
+   other.operations = 0;
+}
+
+DmaBuffer& DmaBuffer::operator=(DmaBuffer&& other)
+{
+   if (this != &other) {
+      release();
+      ptr = other.ptr;
+      length = other.length;
+      reads = std::move(other.reads);
+      operations = other.operations;
+      other.ptr = nullptr;
+      other.length = 0;
+      other.reads.clear();
+      other.operations = 0;
+   }
+   return *this;
+}
+
+DmaBuffer::~DmaBuffer()
+{
+   release();
+}
+
+void DmaBuffer::addRead(ReadTracker* tracker, uint64_t epoch)
+{
+   operations++;
+   for (PendingRead& read : reads) {
+      if (read.tracker == tracker) {
+         if (epoch > read.epoch) {
+            read.epoch = epoch;
+         }
+         return;
+      }
+   }
+   reads.push_back({tracker, epoch});
+}
+
+/*
+ * Number of operations issued on the buffer since it was last seen idle,
+ * polls the trackers
+ */
+uint32_t DmaBuffer::outstanding()
+{
+   if (operations > 0 && isRead(reads, true)) {
+      operations = 0;
+      reads.clear();
+   }
+   return operations;
+}
+
+void DmaBuffer::release()
+{
+   if (ptr == nullptr) {
+      return;
+   }
+   if (operations == 0 || isRead(reads, false)) {
+      Fpga::free(ptr);
+   } else {
+      std::lock_guard<std::mutex> guard(retiredMutex);
+      retired.push_back({ptr, std::move(reads)});
+   }
+   ptr = nullptr;
+   length = 0;
+   reads.clear();
+   operations = 0;
+}
+
+/*
+ * Frees all retired chunks the FPGA is done with
+ */
+void DmaBuffer::reclaim()
+{
+   std::lock_guard<std::mutex> guard(retiredMutex);
+   auto it = retired.begin();
+   while (it != retired.end()) {
+      if (isRead(it->reads, true)) {
+         Fpga::free(it->ptr);
+         it = retired.erase(it);
+      } else {
+         ++it;
+      }
+   }
+}
+
+/*
+ * Waits for the retired chunks, gives up after drainTimeoutMs since trackers
+ * without polling only make progress when their owner synchronizes
+ */
+void DmaBuffer::drain()
+{
+   auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(drainTimeoutMs);
+   while (true) {
+      reclaim();
+      {
+         std::lock_guard<std::mutex> guard(retiredMutex);
+         if (retired.empty()) {
+            return;
+         }
+         if (std::chrono::steady_clock::now() > deadline) {
+            std::cerr << "[ERROR] " << retired.size() << " DMA buffers are still read, not freed" << std::endl;
+            return;
+         }
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(1));
+   }
+}
+
+/*
+ * A read of a tracker that no longer exists can never be confirmed, the
+ * chunk stays allocated
+ */
+bool DmaBuffer::isRead(const std::vector<PendingRead>& reads, bool poll)
+{
+   std::lock_guard<std::mutex> guard(trackerMutex);
+   for (const PendingRead& read : reads) {
+      if (trackers.count(read.tracker) == 0 || read.tracker->readsCompleted(poll) < read.epoch) {
+         return false;
+      }
+   }
+   return true;
+}
+
+} /* namespace fpga */
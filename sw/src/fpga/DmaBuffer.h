@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef DMA_BUFFER_H
+#define DMA_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace fpga {
+
+/*
+ * Source of read completions for operations on DmaBuffers, usually a
+ * communicator. Epochs are counted by the tracker and only comparable within
+ * it: an operation with epoch e is done once completed() reaches e.
+ * A tracker that goes away stops all buffers waiting on it from being freed.
+ */
+class ReadTracker {
+
+public:
+   ReadTracker();
+   virtual ~ReadTracker();
+
+   ReadTracker(ReadTracker const&)      = delete;
+   void operator =(ReadTracker const&)  = delete;
+
+   //poll may look for new completions, otherwise only the known ones count
+   virtual uint64_t readsCompleted(bool poll) = 0;
+
+protected:
+   //Has to be called before the members readsCompleted uses are destroyed
+   void untrack();
+};
+
+struct PendingRead {
+   ReadTracker* tracker;
+   uint64_t     epoch;
+};
+
+/*
+ * Move-only handle to a chunk of DMA memory that remembers the operations
+ * still reading it, as the latest epoch per tracker. The operations of one
+ * tracker complete in order, so that epoch covers all of them.
+ *
+ * A buffer released while it is still read is retired and only returned to
+ * the allocator once all its trackers have passed their epochs.
+ */
+class DmaBuffer {
+
+public:
+   DmaBuffer();
+   explicit DmaBuffer(uint64_t size, bool zero=true);
+   DmaBuffer(DmaBuffer&& other);
+   DmaBuffer& operator=(DmaBuffer&& other);
+   ~DmaBuffer();
+
+   DmaBuffer(DmaBuffer const&)         = delete;
+   void operator =(DmaBuffer const&)   = delete;
+
+   void* data() const { return ptr; }
+   uint64_t size() const { return length; }
+   template <class T>
+   T* as() const { return (T*) ptr; }
+
+   void addRead(ReadTracker* tracker, uint64_t epoch);
+   uint32_t outstanding();
+   void release();
+
+   static void reclaim();
+   static void drain();
+
+private:
+   static bool isRead(const std::vector<PendingRead>& reads, bool poll);
+
+   void*    ptr;
+   uint64_t length;
+   std::vector<PendingRead> reads;
+   uint32_t operations;
+
+};
+
+} /* namespace fpga */
+
+#endif
@@ -30,113 +30,438 @@
 #include <sys/ioctl.h>
 #include "../../../driver/xdma_ioctl.h"
 
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <fpga/Configuration.h>
+#include <fpga/ThreadCache.h>
 
 namespace fpga {
 
-FpgaController* Fpga::controller = nullptr;
+std::vector<FpgaController*> Fpga::controllers;
 MemoryManager* Fpga::mm = nullptr;
 int Fpga::nodeId;
-int Fpga::fd;
-int Fpga::byfd;
+uint32_t Fpga::numberOfDevices = 1;
+bool Fpga::hugePageAligned = false;
+int Fpga::numaNode = Numa::DEVICE_NODE;
+std::vector<int> Fpga::fds;
+std::vector<int> Fpga::byfds;
 int Fpga::hfd;
 void* Fpga::huge_base = nullptr;
+uint64_t Fpga::mapped_size = 0;
+bool Fpga::huge_zeroed = false;
+
+static double elapsedMs(std::chrono::high_resolution_clock::time_point start) {
+   auto end = std::chrono::high_resolution_clock::now();
+   return std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() / 1000.0;
+}
 
 
 void Fpga::setNodeId(int _nodeId) {
    nodeId = _nodeId;
 }
 
-void Fpga::initializeMemory() {
-   //Open huge pages device
-   if ((hfd = open("/media/huge/abc", O_CREAT | O_RDWR | O_SYNC, 0755)) == -1) {
-      std::cerr << "[ERROR] on open /media/huge/abc";
+/*
+ * Number of FPGAs opened by initializeMemory. Card 0 is /dev/xdma_control,
+ * card d is /dev/xdma_control<d>. The DMA region is shared, it is pinned on
+ * every card and mapped into every TLB, so any buffer can be used with any
+ * card.
+ */
+void Fpga::setNumberOfDevices(uint32_t count) {
+   if (count == 0 || count > fpga::Configuration::MAX_DEVICES) {
+      std::cerr << "[ERROR] number of devices has to be between 1 and " << fpga::Configuration::MAX_DEVICES << std::endl;
       exit(1);
    }
-   printf("huge device /media/huge/abc opened.\n"); fflush(stdout);
+   numberOfDevices = count;
+}
 
-   //Map huge pages
-   huge_base = mmap(0, fpga::Configuration::DMA_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, hfd, 0);
-   if (huge_base == (void*) -1) {
-      std::cerr << "[ERROR] on mmap of huge_base";
+/*
+ * Places allocations so that they never straddle a huge page and are not
+ * split into multiple DMA commands by the TLB
+ */
+void Fpga::setHugePageAligned(bool enable) {
+   hugePageAligned = enable;
+   if (mm != nullptr) {
+      mm->setHugePageBoundary(enable ? fpga::Configuration::HUGE_PAGE_SIZE : 0);
+   }
+}
+
+/*
+ * Node the DMA region is bound to, by default the node of the FPGA. Has to
+ * be set before initializeMemory.
+ */
+void Fpga::setNumaNode(int node) {
+   numaNode = node;
+}
+
+//Pins the calling thread, by default next to the FPGA
+bool Fpga::pinThread(int node) {
+   return Numa::pinThread(node);
+}
+
+/*
+ * Reserves address space for the largest region the TLB can map and pins only
+ * the first segment of it. Further segments are mapped, pinned and appended
+ * to the TLB when the memory manager runs out of memory.
+ *
+ * The huge page file is truncated, so every page comes zeroed from the kernel
+ * and the memory manager does not have to clear it again.
+ */
+void Fpga::initializeMemory(bool backgroundZeroing) {
+   auto startupStart = std::chrono::high_resolution_clock::now();
+   auto phaseStart = startupStart;
+
+   //Sizes and paths from DAVOS_CONFIG and the environment
+   if (!fpga::Configuration::isLoaded() && !fpga::Configuration::load()) {
       exit(1);
    }
-   printf("huge device mapped at %p\n", huge_base);
+   fpga::Configuration::print();
+   uint64_t hugePageSize = fpga::Configuration::hugePageSize;
 
-   //Open xdma_control device
-   if ((fd = open("/dev/xdma_control", O_RDWR | O_SYNC)) == -1) {
-      std::cerr << "[ERROR] on open /dev/xdma_control";
+   //Open huge pages device, a private file per process so the truncation
+   //never frees pages of another process using the same huge_path
+   std::string privatePath = fpga::Configuration::hugePath + "." + std::to_string(getpid());
+   if ((hfd = open(privatePath.c_str(), O_CREAT | O_RDWR | O_SYNC, 0600)) == -1) {
+      std::cerr << "[ERROR] on open " << privatePath;
       exit(1);
    }
+   unlink(privatePath.c_str());
+   huge_zeroed = (ftruncate(hfd, 0) == 0);
+   printf("huge device %s opened.\n", privatePath.c_str()); fflush(stdout);
 
-   //Open xdma_bypass device
-   if ((byfd = open("/dev/xdma_bypass", O_RDWR | O_SYNC)) == -1) {
-      std::cerr << "[ERROR] on open /dev/xdma_bypass";
+   //Reserve huge page aligned address space, the TLB needs it contiguous
+   uint64_t reserveSize = fpga::Configuration::maxDmaSize + hugePageSize;
+   void* reserved = mmap(0, reserveSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   if (reserved == (void*) -1) {
+      std::cerr << "[ERROR] on mmap of huge_base";
       exit(1);
    }
+   uint64_t start = (uint64_t) reserved;
+   uint64_t aligned = (start + hugePageSize - 1) & ~(hugePageSize - 1);
+   if (aligned > start) {
+      munmap(reserved, aligned - start);
+   }
+   munmap((void*) (aligned + fpga::Configuration::maxDmaSize), start + reserveSize - aligned - fpga::Configuration::maxDmaSize);
+   huge_base = (void*) aligned;
+   mapped_size = 0;
+   printf("huge device reserved at %p\n", huge_base);
+   numaNode = Numa::resolveNode(numaNode);
+   if (numaNode != Numa::ANY_NODE) {
+      printf("huge pages bound to node %d\n", numaNode);
+   }
+   double reserveMs = elapsedMs(phaseStart);
+   phaseStart = std::chrono::high_resolution_clock::now();
+
+   for (uint32_t d = controllers.size(); d < numberOfDevices; ++d) {
+      std::string suffix = (d == 0) ? "" : std::to_string(d);
+      std::string controlPath = "/dev/xdma_control" + suffix;
+      std::string bypassPath = "/dev/xdma_bypass" + suffix;
+
+      //Open xdma_control device
+      int fd;
+      if ((fd = open(controlPath.c_str(), O_RDWR | O_SYNC)) == -1) {
+         std::cerr << "[ERROR] on open " << controlPath;
+         exit(1);
+      }
+
+      //Open xdma_bypass device
+      int byfd;
+      if ((byfd = open(bypassPath.c_str(), O_RDWR | O_SYNC)) == -1) {
+         std::cerr << "[ERROR] on open " << bypassPath;
+         exit(1);
+      }
 
-   printf("dma device /dev/xdma_control opened.\n"); fflush(stdout);
-   printf("bypass device /dev/xdma_bypass opened.\n"); fflush(stdout);
-   if  (controller == nullptr) {
-      controller = new FpgaController(fd, byfd);
+      printf("dma device %s opened.\n", controlPath.c_str()); fflush(stdout);
+      printf("bypass device %s opened.\n", bypassPath.c_str()); fflush(stdout);
+      fds.push_back(fd);
+      byfds.push_back(byfd);
+      controllers.push_back(new FpgaController(fd, byfd));
    }
 
+   double devicesMs = elapsedMs(phaseStart);
+   phaseStart = std::chrono::high_resolution_clock::now();
+
    printf("huge_base: %p\n", huge_base);
-   //ioctl to get mapping
+   if (!mapSegment(0, fpga::Configuration::initialDmaSize)) {
+      exit(1);
+   }
+   double mapMs = elapsedMs(phaseStart);
+   phaseStart = std::chrono::high_resolution_clock::now();
+
+   mm = new MemoryManager(huge_base, mapped_size, huge_zeroed, fpga::Configuration::maxDmaSize);
+   mm->setGrowHandler(growMemory, huge_zeroed);
+   setHugePageAligned(hugePageAligned);
+#ifdef CREDIT_WRITEBACK
+   for (FpgaController* controller : controllers) {
+      controller->setCreditWord((volatile uint64_t*) mm->allocate(64, true, 64, 0));
+   }
+#endif
+   if (backgroundZeroing) {
+      mm->startZeroing();
+   }
+   double mmMs = elapsedMs(phaseStart);
+
+   printf("startup time [ms]: reserve %.3f, devices %.3f, map %.3f, memory manager %.3f, total %.3f\n",
+          reserveMs, devicesMs, mapMs, mmMs, elapsedMs(startupStart));
+}
+
+/*
+ * Maps the huge pages at offset and faults them in on several threads. The
+ * calling thread pins every part and writes its TLB entries as soon as it is
+ * populated, so pinning and TLB programming overlap with population. Entries
+ * of earlier segments are not touched, so DMA on them can continue.
+ */
+bool Fpga::mapSegment(uint64_t offset, uint64_t size) {
+   auto segmentStart = std::chrono::high_resolution_clock::now();
+   void* segment = (void*) (((uint64_t) huge_base) + offset);
+   if (mmap(segment, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, hfd, offset) == (void*) -1) {
+      std::cerr << "[ERROR] on mmap of huge pages at offset " << offset << std::endl;
+      return false;
+   }
+   printf("huge device mapped at %p, size %lu\n", segment, size);
+   //Bind before the pages are faulted in
+   if (numaNode != Numa::ANY_NODE) {
+      Numa::bindMemory(segment, size, numaNode);
+   }
+
+   uint64_t partSize = fpga::Configuration::populatePartSize;
+   uint64_t numParts = (size + partSize - 1) / partSize;
+   uint32_t numThreads = std::thread::hardware_concurrency();
+   if (numThreads == 0 || numThreads > fpga::Configuration::populateThreads) {
+      numThreads = fpga::Configuration::populateThreads;
+   }
+   if (numThreads > numParts) {
+      numThreads = numParts;
+   }
+
+   std::unique_ptr<std::atomic<bool>[]> populated(new std::atomic<bool>[numParts]);
+   for (uint64_t i = 0; i < numParts; ++i) {
+      populated[i] = false;
+   }
+   std::atomic<uint64_t> nextPart(0);
+   std::atomic<uint64_t> populateUs(0);
+   std::vector<std::thread> populateThreads;
+   for (uint32_t t = 0; t < numThreads; ++t) {
+      populateThreads.emplace_back([&]() {
+         for (uint64_t part = nextPart++; part < numParts; part = nextPart++) {
+            volatile char* page = ((char*) segment) + part * partSize;
+            volatile char* end = ((char*) segment) + std::min((part + 1) * partSize, size);
+            for (; page < end; page += fpga::Configuration::hugePageSize) {
+               *page = *page;
+            }
+            populated[part].store(true, std::memory_order_release);
+         }
+         uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - segmentStart).count();
+         uint64_t prev = populateUs.load();
+         while (us > prev && !populateUs.compare_exchange_weak(prev, us));
+      });
+   }
+
+   bool success = true;
+   for (uint64_t part = 0; part < numParts && success; ++part) {
+      while (!populated[part].load(std::memory_order_acquire)) {
+         std::this_thread::yield();
+      }
+      uint64_t partOffset = offset + part * partSize;
+      uint64_t partBytes = std::min(partSize, offset + size - partOffset);
+      success = pinSegment(partOffset, partBytes);
+      for (uint32_t d = 0; d < controllers.size() && success; ++d) {
+         success = writeSegmentTlb(d, partOffset, partBytes);
+      }
+   }
+   if (!success) {
+      nextPart = numParts;
+   }
+   for (std::thread& thread : populateThreads) {
+      thread.join();
+   }
+   if (!success) {
+      //Parts pinned so far stay pinned, but are not handed to the memory manager
+      munmap(segment, size);
+      mmap(segment, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+      return false;
+   }
+
+   mapped_size = offset + size;
+   printf("segment of %lu MiB with %u threads [ms]: populate %.3f, total %.3f\n",
+          size / (1024*1024), numThreads, populateUs.load() / 1000.0, elapsedMs(segmentStart));
+   return true;
+}
+
+bool Fpga::pinSegment(uint64_t offset, uint64_t size) {
+   for (uint32_t d = 0; d < controllers.size(); ++d) {
+      if (!pinSegment(d, offset, size)) {
+         return false;
+      }
+   }
+   return true;
+}
+
+/*
+ * Pins already mapped huge pages on one card, they are appended to the
+ * buffer pinned so far.
+ */
+bool Fpga::pinSegment(uint32_t device, uint64_t offset, uint64_t size) {
+   int fd = fds[device];
+   void* segment = (void*) (((uint64_t) huge_base) + offset);
    struct xdma_huge huge;
-   huge.addr = (unsigned long) huge_base;
-   huge.size = (unsigned long) fpga::Configuration::DMA_SIZE;
+   huge.addr = (unsigned long) segment;
+   huge.size = (unsigned long) size;
+#ifdef PRINT_DEBUG
    printf("IOCTL_XDMA_BUFFER_Set\n"); fflush(stdout);
+#endif
 
    if (ioctl(fd, IOCTL_XDMA_BUFFER_SET, &huge) == -1) {
       printf("IOCTL SET failed.\n");
-      //return -1;
+      return false;
    }
+   return true;
+}
 
-   //Get mapping from driver
+/*
+ * Writes the TLB entries of a pinned segment on one card. Only the mapping of
+ * the segment itself is fetched from the driver.
+ */
+bool Fpga::writeSegmentTlb(uint32_t device, uint64_t offset, uint64_t size) {
+   void* segment = (void*) (((uint64_t) huge_base) + offset);
+   uint64_t firstPage = offset / fpga::Configuration::HUGE_PAGE_SIZE;
    struct xdma_huge_mapping map;
-   map.npages = huge.size / (2 * 1024 * 1024);
-   map.dma_addr = (unsigned long*) calloc(map.npages, sizeof(unsigned long*));
+   map.offset = firstPage;
+   map.npages = size / fpga::Configuration::HUGE_PAGE_SIZE;
+   map.dma_addr = (unsigned long*) calloc(map.npages, sizeof(unsigned long));
+#ifdef PRINT_DEBUG
    printf("IOCTL_XDMA_MAPPING_GET\n"); fflush(stdout);
+#endif
 
-   if (ioctl(fd, IOCTL_XDMA_MAPPING_GET, &map) == -1) {
+   if (ioctl(fds[device], IOCTL_XDMA_MAPPING_GET, &map) == -1) {
       printf("IOCTL GET failed.\n");
-      //return -1;
+      free(map.dma_addr);
+      return false;
    }
 
-   //Insert TLB entries
-   printf("npages: %lu, write TLB\n", map.npages); fflush(stdout);
+   //Insert TLB entries of the new pages
+   unsigned long vaddr = (unsigned long) segment;
+#ifdef TLB_BULK_LOAD
+   if (loadTlbBulk(device, segment, map.dma_addr, map.npages, (firstPage == 0))) {
+      free(map.dma_addr);
+      return true;
+   }
+#endif
+   for (uint64_t i = 0; i < map.npages; i++) {
+      controllers[device]->writeTlb(vaddr, map.dma_addr[i], (firstPage + i == 0));
+      vaddr += fpga::Configuration::HUGE_PAGE_SIZE;
+   }
+   free(map.dma_addr);
+   return true;
+}
 
-   unsigned long vaddr = (unsigned long) huge_base;
-   for (int i = 0; i < map.npages; i++) {
-      controller->writeTlb(vaddr, map.dma_addr[i], (i == 0));
-      vaddr += (2*1024*1024);
+#ifdef TLB_BULK_LOAD
+/*
+ * Writes the table of physical addresses into the first huge page of the new
+ * segment, which is not yet handed out, and lets the TLB fetch it with a single
+ * command. Returns false if the TLB did not complete the load in time.
+ */
+bool Fpga::loadTlbBulk(uint32_t device, void* segment, const unsigned long* paddrs, uint64_t numPages, bool isBase) {
+   uint64_t* table = (uint64_t*) segment;
+   for (uint64_t i = 0; i < numPages; i++) {
+      table[i] = paddrs[i];
    }
+   __sync_synchronize();
 
-   printf("TLB done\n"); fflush(stdout);
-   //free(map.dma_addr);
-   
-   mm = new MemoryManager((void*) huge.addr, huge.size);
+   FpgaController* controller = controllers[device];
+   uint32_t loadedBefore = controller->getTlbBulkEntries();
+   controller->writeTlbBulk((unsigned long) segment, paddrs[0], (uint32_t) numPages, isBase);
 
-   //return 0;
+   bool done = false;
+   auto start = std::chrono::high_resolution_clock::now();
+   while (!done && elapsedMs(start) < 100.0) {
+      done = ((uint32_t) (controller->getTlbBulkEntries() - loadedBefore) >= numPages);
+   }
+   memset(table, 0, numPages * sizeof(uint64_t));
+   if (!done) {
+      std::cerr << "[ERROR] TLB bulk load timed out, writing entries one by one" << std::endl;
+   }
+   return done;
+}
+#endif
+
+/*
+ * Grow handler of the memory manager, called without its lock but never
+ * concurrently. Grows by at least growth_huge_pages to keep the number of
+ * ioctls low.
+ */
+size_t Fpga::growMemory(size_t minimumSize) {
+   uint64_t hugePageSize = fpga::Configuration::hugePageSize;
+   uint64_t growth = fpga::Configuration::growthDmaSize;
+   uint64_t required = ((minimumSize + hugePageSize - 1) / hugePageSize) * hugePageSize;
+   if (required > growth) {
+      growth = required;
+   }
+   uint64_t available = fpga::Configuration::maxDmaSize - mapped_size;
+   if (growth > available) {
+      growth = available;
+   }
+   if (growth < required || growth == 0) {
+      return 0;
+   }
+   uint64_t offset = mapped_size;
+   if (!mapSegment(offset, growth)) {
+      return 0;
+   }
+   return growth;
 }
 
 void Fpga::clear() {
-   delete controller;
+   for (uint32_t d = 0; d < controllers.size(); ++d) {
+#ifdef CREDIT_WRITEBACK
+      controllers[d]->setCreditWord(nullptr);
+#endif
+      delete controllers[d];
+      //Unpin the DMA region on this card
+      if (ioctl(fds[d], IOCTL_XDMA_RELEASE) == -1) {
+         printf("IOCTL RELEASE failed.\n");
+      }
+      close(fds[d]);
+      close(byfds[d]);
+   }
+   controllers.clear();
+   fds.clear();
+   byfds.clear();
    delete mm;
-   munmap(huge_base, fpga::Configuration::DMA_SIZE); //Check return???
-   close(fd);
-   close(byfd);
+   munmap(huge_base, fpga::Configuration::maxDmaSize); //Check return???
    close(hfd);
 }
 
 
-void* Fpga::allocate(uint64_t size) {
-   return mm->allocate(size);
+void* Fpga::allocate(uint64_t size, bool zero, uint64_t alignment, uint8_t tag) {
+   if (alignment != 0 || tag != 0) {
+      void* ptr = mm->allocate(size, zero, alignment, tag);
+      if (ptr == nullptr && ThreadCache::reclaim(mm)) {
+         ptr = mm->allocate(size, zero, alignment, tag);
+      }
+      return ptr;
+   }
+   return ThreadCache::allocate(mm, size, zero);
 }
 
 void Fpga::free(void* ptr) {
-   mm->free(ptr);
+   ThreadCache::free(mm, ptr);
+}
+
+MemoryManager::MemoryStats Fpga::getMemoryStats() {
+   return mm->getStats();
+}
+
+void Fpga::printMemoryStats() {
+   mm->printStats();
+}
+
+void Fpga::setTagName(uint8_t tag, const std::string& name) {
+   mm->setTagName(tag, name);
 }
 
 
@@ -30,6 +30,9 @@
 
 #include <fpga/FpgaController.h>
 #include <fpga/MemoryManager.h>
+#include <fpga/Numa.h>
+
+#include <vector>
 
 namespace fpga {
 
@@ -39,23 +42,46 @@ class Fpga {
 
 public:
    static void setNodeId(int nodeId);
-   static void initializeMemory();
+   static void setNumberOfDevices(uint32_t count);
+   static uint32_t getNumberOfDevices() { return controllers.size(); }
+   static void setHugePageAligned(bool enable);
+   static void setNumaNode(int node);
+   static int getNumaNode() { return numaNode; }
+   static bool pinThread(int node=Numa::DEVICE_NODE);
+   static void initializeMemory(bool backgroundZeroing=false);
    static void clear();
-   static void* allocate(uint64_t size);
+   static void* allocate(uint64_t size, bool zero=true, uint64_t alignment=0, uint8_t tag=0);
    static void free(void * memory);
+   static MemoryManager::MemoryStats getMemoryStats();
+   static void printMemoryStats();
+   static void setTagName(uint8_t tag, const std::string& name);
    
-   static FpgaController* getController() { return controller; }
+   static FpgaController* getController(uint32_t device=0) { return controllers[device]; }
    
 protected:
-   static FpgaController* controller;
+   static std::vector<FpgaController*> controllers;
    static MemoryManager*  mm;
 
 private:
    static int      nodeId;
-   static int      fd;
-   static int      byfd;
+   static uint32_t numberOfDevices;
+   static bool     hugePageAligned;
+   static int      numaNode;
+   static std::vector<int> fds;
+   static std::vector<int> byfds;
    static int      hfd;
    static void*    huge_base;
+   static uint64_t mapped_size;
+   static bool     huge_zeroed;
+
+   static bool   mapSegment(uint64_t offset, uint64_t size);
+   static bool   pinSegment(uint64_t offset, uint64_t size);
+   static bool   pinSegment(uint32_t device, uint64_t offset, uint64_t size);
+   static bool   writeSegmentTlb(uint32_t device, uint64_t offset, uint64_t size);
+#ifdef TLB_BULK_LOAD
+   static bool   loadTlbBulk(uint32_t device, void* segment, const unsigned long* paddrs, uint64_t numPages, bool isBase);
+#endif
+   static size_t growMemory(size_t minimumSize);
    
 };
 
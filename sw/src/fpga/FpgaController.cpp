@@ -27,8 +27,11 @@
 #include "FpgaController.h"
 
 #include <cstring>
+#include <algorithm>
 #include <thread>
 #include <chrono>
+
+#include "../../../driver/xdma_ioctl.h"
               
 //#define PRINT_DEBUG
 
@@ -38,15 +41,23 @@ namespace fpga {
 
 std::mutex FpgaController::ctrl_mutex;
 std::mutex FpgaController::btree_mutex;
-std::atomic_uint FpgaController::cmdCounter = ATOMIC_VAR_INIT(0);
 uint64_t FpgaController::mmTestValue;
 
 FpgaController::FpgaController(int fd, int byfd)
+   :post_base(nullptr), cmdReserved(0), cmdPosted(0), cmdConsumed(0), creditWord(nullptr), benchmarkPrevious{0, 0, 0}
 {
    //open control device
    m_base = mmap(0, MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
    //open bypass device
    by_base =  mmap(0, MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, byfd, 0);
+#ifdef POST_WINDOW
+   //Without the window commands are posted to the uncached POST register
+   post_base = mmap(0, XDMA_BYPASS_POST_WINDOW_SIZE, PROT_WRITE, MAP_SHARED, byfd, XDMA_BYPASS_POST_WINDOW_OFFSET);
+   if (post_base == MAP_FAILED) {
+      std::cerr << "[ERROR] on mmap of the post window, posting without it" << std::endl;
+      post_base = nullptr;
+   }
+#endif
 }
 
 FpgaController::~FpgaController()
@@ -60,24 +71,72 @@ FpgaController::~FpgaController()
    {
       std::cerr << "Error on unmap of bypass device" << std::endl;
    }
+
+   if (post_base != nullptr && munmap(post_base, XDMA_BYPASS_POST_WINDOW_SIZE) == -1)
+   {
+      std::cerr << "Error on unmap of post window" << std::endl;
+   }
 }
 
+/*
+ * With BYPASS_PROGRAMMING, TLB entries, contexts and connections are written
+ * with a single 256-bit transaction to the bypass region instead of one
+ * AXI-Lite write per word. A single write cannot interleave with another
+ * thread's, so no lock is taken.
+ */
 void FpgaController::writeTlb(unsigned long vaddr, unsigned long paddr, bool isBase)
 {
-   std::lock_guard<std::mutex> guard(ctrl_mutex);
 #ifdef PRINT_DEBUG
    printf("Writing tlb mapping\n");fflush(stdout);
 #endif
+#ifdef BYPASS_PROGRAMMING
+   SETUP_VAL entry = {{(uint32_t) vaddr, (uint32_t) (vaddr >> 32), (uint32_t) paddr, (uint32_t) (paddr >> 32), (uint32_t) isBase, 0, 0, 0}};
+   optwriteReg(dmaCtrlAddr::TLB, &entry.x);
+#else
+   std::lock_guard<std::mutex> guard(ctrl_mutex);
    writeReg(dmaCtrlAddr::TLB, (uint32_t) vaddr);
    writeReg(dmaCtrlAddr::TLB, (uint32_t) (vaddr >> 32));
    writeReg(dmaCtrlAddr::TLB, (uint32_t) paddr);
    writeReg(dmaCtrlAddr::TLB, (uint32_t) (paddr >> 32));
    writeReg(dmaCtrlAddr::TLB, (uint32_t) isBase);
+#endif
 #ifdef PRINT_DEBUG
    printf("done\n");fflush(stdout);
 #endif
 }
 
+#ifdef TLB_BULK_LOAD
+/*
+ * The TLB fetches numEntries physical addresses, one 64-bit word per 2MB page
+ * starting at vaddr, by DMA from tablePaddr. Completion can be tracked with
+ * getTlbBulkEntries.
+ */
+void FpgaController::writeTlbBulk(unsigned long vaddr, unsigned long tablePaddr, uint32_t numEntries, bool isBase)
+{
+#ifdef PRINT_DEBUG
+   printf("Writing tlb bulk command\n");fflush(stdout);
+#endif
+#ifdef BYPASS_PROGRAMMING
+   SETUP_VAL cmd = {{(uint32_t) vaddr, (uint32_t) (vaddr >> 32), (uint32_t) tablePaddr, (uint32_t) (tablePaddr >> 32), numEntries, (uint32_t) isBase, 0, 0}};
+   optwriteReg(dmaCtrlAddr::TLB_BULK, &cmd.x);
+#else
+   std::lock_guard<std::mutex> guard(ctrl_mutex);
+   writeReg(dmaCtrlAddr::TLB_BULK, (uint32_t) vaddr);
+   writeReg(dmaCtrlAddr::TLB_BULK, (uint32_t) (vaddr >> 32));
+   writeReg(dmaCtrlAddr::TLB_BULK, (uint32_t) tablePaddr);
+   writeReg(dmaCtrlAddr::TLB_BULK, (uint32_t) (tablePaddr >> 32));
+   writeReg(dmaCtrlAddr::TLB_BULK, numEntries);
+   writeReg(dmaCtrlAddr::TLB_BULK, (uint32_t) isBase);
+#endif
+}
+
+uint32_t FpgaController::getTlbBulkEntries()
+{
+   std::lock_guard<std::mutex> guard(ctrl_mutex);
+   return readReg(dmaCtrlAddr::TLB_BULK);
+}
+#endif
+
 uint64_t FpgaController::runDmaSeqWriteBenchmark(uint64_t baseAddr, uint64_t memorySize, uint32_t numberOfAccesses, uint32_t chunkLength)
 {
    return runDmaBenchmark(baseAddr, memorySize, numberOfAccesses, chunkLength, 0, memoryOp::WRITE);
@@ -99,11 +158,18 @@ uint64_t FpgaController::runDmaRandomReadBenchmark(uint64_t baseAddr, uint64_t m
 }
 
 uint64_t FpgaController::runDmaBenchmark(uint64_t baseAddr, uint64_t memorySize, uint32_t numberOfAccesses, uint32_t chunkLength, uint32_t strideLength, memoryOp op)
+{
+   startDmaBenchmark(baseAddr, memorySize, numberOfAccesses, chunkLength, strideLength, op);
+   return waitBenchmark(benchmarkType::DMA);
+}
+
+void FpgaController::startDmaBenchmark(uint64_t baseAddr, uint64_t memorySize, uint32_t numberOfAccesses, uint32_t chunkLength, uint32_t strideLength, memoryOp op)
 {
    std::lock_guard<std::mutex> guard(ctrl_mutex);
 #ifdef PRINT_DEBUG
    printf("Run dma benchmark\n");fflush(stdout);
 #endif
+   prepareBenchmark(benchmarkType::DMA);
 
    writeReg(userCtrlAddr::DMA_BENCH, (uint32_t) baseAddr);
    writeReg(userCtrlAddr::DMA_BENCH, (uint32_t) (baseAddr >> 32));
@@ -113,23 +179,7 @@ uint64_t FpgaController::runDmaBenchmark(uint64_t baseAddr, uint64_t memorySize,
    writeReg(userCtrlAddr::DMA_BENCH, (uint32_t) chunkLength);
    writeReg(userCtrlAddr::DMA_BENCH, (uint32_t) strideLength);
    writeReg(userCtrlAddr::DMA_BENCH, (uint32_t) op);
-
-   //retrieve number of execution cycles
-   
-   uint64_t lower = 0;
-   uint64_t upper = 0;
-   do
-   {
-      std::this_thread::sleep_for(1s);
-      lower = readReg(userCtrlAddr::DMA_BENCH_CYCLES);
-      upper = readReg(userCtrlAddr::DMA_BENCH_CYCLES);
-   } while (lower == 0);
-   return ((upper << 32) | lower);
-
-
-#ifdef PRINT_DEBUG
-   printf("done\n");fflush(stdout);
-#endif
+   benchmarkStart[(int) benchmarkType::DMA] = std::chrono::high_resolution_clock::now();
 }
 
 uint64_t FpgaController::runDramSeqWriteBenchmark(uint64_t baseAddr, uint64_t memorySize, uint32_t numberOfAccesses, uint32_t chunkLength, uint8_t channel)
@@ -153,11 +203,18 @@ uint64_t FpgaController::runDramRandomReadBenchmark(uint64_t baseAddr, uint64_t
 }
 
 uint64_t FpgaController::runDramBenchmark(uint64_t baseAddr, uint64_t memorySize, uint32_t numberOfAccesses, uint32_t chunkLength, uint32_t strideLength, memoryOp op, uint8_t channel)
+{
+   startDramBenchmark(baseAddr, memorySize, numberOfAccesses, chunkLength, strideLength, op, channel);
+   return waitBenchmark(benchmarkType::DRAM);
+}
+
+void FpgaController::startDramBenchmark(uint64_t baseAddr, uint64_t memorySize, uint32_t numberOfAccesses, uint32_t chunkLength, uint32_t strideLength, memoryOp op, uint8_t channel)
 {
    std::lock_guard<std::mutex> guard(ctrl_mutex);
 #ifdef PRINT_DEBUG
-   printf("Run dma benchmark\n");fflush(stdout);
+   printf("Run dram benchmark\n");fflush(stdout);
 #endif
+   prepareBenchmark(benchmarkType::DRAM);
 
    writeReg(userCtrlAddr::DDR_BENCH, (uint32_t) baseAddr);
    writeReg(userCtrlAddr::DDR_BENCH, (uint32_t) (baseAddr >> 32));
@@ -167,27 +224,20 @@ uint64_t FpgaController::runDramBenchmark(uint64_t baseAddr, uint64_t memorySize
    writeReg(userCtrlAddr::DDR_BENCH, (uint32_t) chunkLength);
    writeReg(userCtrlAddr::DDR_BENCH, (uint32_t) strideLength);
    writeReg(userCtrlAddr::DDR_BENCH, (((uint32_t) channel) << 1) | ((uint32_t) op));
-
-   //retrieve number of execution cycles
-   
-   uint64_t lower = 0;
-   uint64_t upper = 0;
-   do
-   {
-      std::this_thread::sleep_for(1s);
-      lower = readReg(userCtrlAddr::DDR_BENCH_CYCLES);
-      upper = readReg(userCtrlAddr::DDR_BENCH_CYCLES);
-   } while (lower == 0);
-   return ((upper << 32) | lower);
-
-
-#ifdef PRINT_DEBUG
-   printf("done\n");fflush(stdout);
-#endif
+   benchmarkStart[(int) benchmarkType::DRAM] = std::chrono::high_resolution_clock::now();
 }
 
 uint64_t FpgaController::runIperfBenchmark(bool dualModeEn, uint16_t numConnections, uint8_t wordCounter, uint8_t packetGap, uint32_t timeInHectoSeconds, uint64_t timeInCycles)
 {
+   startIperfBenchmark(dualModeEn, numConnections, wordCounter, packetGap, timeInHectoSeconds, timeInCycles);
+   return waitBenchmark(benchmarkType::IPERF);
+}
+
+void FpgaController::startIperfBenchmark(bool dualModeEn, uint16_t numConnections, uint8_t wordCounter, uint8_t packetGap, uint32_t timeInHectoSeconds, uint64_t timeInCycles)
+{
+   std::lock_guard<std::mutex> guard(ctrl_mutex);
+   prepareBenchmark(benchmarkType::IPERF);
+
    //TODO include target address
    uint32_t cmd = (packetGap << 24) | (wordCounter << 16) | ((numConnections & 0x7FFF) << 1) | dualModeEn;
 
@@ -195,22 +245,75 @@ uint64_t FpgaController::runIperfBenchmark(bool dualModeEn, uint16_t numConnecti
    writeReg(userCtrlAddr::IPERF_BENCH, timeInHectoSeconds);
    writeReg(userCtrlAddr::IPERF_BENCH, (uint32_t) timeInCycles);
    writeReg(userCtrlAddr::IPERF_BENCH, (uint32_t) (timeInCycles >> 32));
+   benchmarkStart[(int) benchmarkType::IPERF] = std::chrono::high_resolution_clock::now();
+}
 
-   //retrieve number of execution cycles
-   
-   uint64_t lower = 0;
-   uint64_t upper = 0;
-   do
-   {
-      std::this_thread::sleep_for(1s);
-      lower = readReg(userCtrlAddr::IPERF_CYCLES);
-      upper = readReg(userCtrlAddr::IPERF_CYCLES);
-   } while (lower == 0);
+/*
+ * The role clears the cycle register when a benchmark starts, but the clear
+ * reaches the register later than the start command. Until then the value
+ * of the previous run is still there, so it is only accepted once
+ * benchmarkClearUs have passed.
+ */
+void FpgaController::prepareBenchmark(benchmarkType type)
+{
+   benchmarkPrevious[(int) type] = readCycles(type);
+}
+
+uint64_t FpgaController::readCycles(benchmarkType type)
+{
+   static const userCtrlAddr cycleRegs[] = {userCtrlAddr::DMA_BENCH_CYCLES, userCtrlAddr::DDR_BENCH_CYCLES, userCtrlAddr::IPERF_CYCLES};
+   //lower and upper half are read alternately
+   uint64_t lower = readReg(cycleRegs[(int) type]);
+   uint64_t upper = readReg(cycleRegs[(int) type]);
    return ((upper << 32) | lower);
 }
 
+bool FpgaController::pollBenchmark(benchmarkType type, uint64_t& cycles)
+{
+   std::lock_guard<std::mutex> guard(ctrl_mutex);
+   uint64_t value = readCycles(type);
+   if ((uint32_t) value == 0) {
+      return false;
+   }
+   if (value == benchmarkPrevious[(int) type]) {
+      auto elapsed = std::chrono::high_resolution_clock::now() - benchmarkStart[(int) type];
+      if ((uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() < benchmarkClearUs) {
+         return false;
+      }
+   }
+   cycles = value;
+   return true;
+}
+
+/*
+ * Polls with an interval that starts at 1 us and doubles up to
+ * benchmarkMaxPollUs. Short intervals are spun, longer ones slept.
+ */
+uint64_t FpgaController::waitBenchmark(benchmarkType type)
+{
+   uint64_t cycles = 0;
+   uint64_t intervalUs = 1;
+   while (!pollBenchmark(type, cycles)) {
+      if (intervalUs < 50) {
+         auto until = std::chrono::high_resolution_clock::now() + std::chrono::microseconds(intervalUs);
+         while (std::chrono::high_resolution_clock::now() < until) {
+            _mm_pause();
+         }
+      } else {
+         std::this_thread::sleep_for(std::chrono::microseconds(intervalUs));
+      }
+      intervalUs = std::min(intervalUs * 2, benchmarkMaxPollUs);
+   }
+#ifdef PRINT_DEBUG
+   printf("done\n");fflush(stdout);
+#endif
+   return cycles;
+}
+
 void FpgaController::setIperfAddress(uint8_t number, uint32_t address)
 {
+   std::lock_guard<std::mutex> guard(ctrl_mutex);
+
    writeReg(userCtrlAddr::IPERF_ADDR, number);
    writeReg(userCtrlAddr::IPERF_ADDR, address);
 }
@@ -312,6 +415,20 @@ void FpgaController::printNetStatsRegs(uint8_t port)
    std::cout << "----------------------------------" << std::endl;
 }
 
+CounterSnapshot FpgaController::readCounters(uint8_t port)
+{
+   CounterSnapshot snapshot;
+   std::lock_guard<std::mutex> guard(ctrl_mutex);
+   snapshot.time = std::chrono::steady_clock::now();
+   for (uint32_t i = 0; i < numDmaStatsRegs; ++i) {
+      snapshot.dma[i] = readReg(dmaCtrlAddr::STATS);
+   }
+   for (uint32_t i = 0; i < numNetStatsRegs; ++i) {
+      snapshot.net[i] = readReg(netCtrlAddr::STATS, port);
+   }
+   return snapshot;
+}
+
 
 /*void FpgaController::writeReg(ctrlAddr addr, uint8_t value)
 {
@@ -400,6 +517,98 @@ uint64_t FpgaController::readMM(mmCtrlAddr addr)
   return htols(*rPtr);
 }
 
+/*
+ * MMIO microbenchmarks. AXI-Lite accesses go to the role's scratch register,
+ * bypass accesses to the TEST registers; neither has side effects. The bypass
+ * BAR is mapped uncached, so every store is its own PCIe write.
+ */
+static inline void mmioFenceOp(mmioFence fence)
+{
+   if (fence == mmioFence::SFENCE) {
+      _mm_sfence();
+   } else if (fence == mmioFence::MFENCE) {
+      _mm_mfence();
+   }
+}
+
+double FpgaController::runMmioWriteBenchmark(mmioAccess access, mmioFence fence, uint64_t iterations)
+{
+   std::lock_guard<std::mutex> guard(ctrl_mutex);
+
+   volatile __m256i* widePtr = (__m256i*) (((uint64_t) by_base) + mmRegAddressOffset + ((uint64_t) mmCtrlAddr::TEST << 5));
+   auto start = std::chrono::high_resolution_clock::now();
+   for (uint64_t i = 0; i < iterations; ++i) {
+      if (access == mmioAccess::AXILITE) {
+         writeReg(userCtrlAddr::SCRATCH, (uint32_t) i);
+      } else if (access == mmioAccess::BYPASS_64) {
+         writeMM(mmCtrlAddr::TEST, i);
+      } else {
+         *widePtr = _mm256_set1_epi64x(i);
+      }
+      mmioFenceOp(fence);
+   }
+   _mm_mfence();
+   auto end = std::chrono::high_resolution_clock::now();
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count() / (double) iterations;
+}
+
+void FpgaController::runMmioReadBenchmark(mmioAccess access, bool afterWrite, std::vector<double>& latencies)
+{
+   std::lock_guard<std::mutex> guard(ctrl_mutex);
+
+   for (size_t s = 0; s < latencies.size(); ++s) {
+      auto start = std::chrono::high_resolution_clock::now();
+      //A read behind a posted write has to wait for the write to drain
+      if (access == mmioAccess::AXILITE) {
+         if (afterWrite) {
+            writeReg(userCtrlAddr::SCRATCH, (uint32_t) s);
+         }
+         mmTestValue += readReg(userCtrlAddr::SCRATCH);
+      } else {
+         if (afterWrite) {
+            writeMM(mmCtrlAddr::TEST_2, s);
+         }
+         mmTestValue += readMM(mmCtrlAddr::TEST);
+      }
+      auto end = std::chrono::high_resolution_clock::now();
+      latencies[s] = std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count();
+   }
+}
+
+/*
+ * Writes the 64-byte line spanned by TEST and TEST_2, every store to a
+ * distinct address: 8 x 64b or 2 x 256b stores.
+ */
+double FpgaController::runMmioLineBenchmark(mmioAccess access, bool fenceEachStore, uint64_t iterations)
+{
+   std::lock_guard<std::mutex> guard(ctrl_mutex);
+
+   volatile uint64_t* linePtr = (uint64_t*) (((uint64_t) by_base) + mmRegAddressOffset + ((uint64_t) mmCtrlAddr::TEST << 5));
+   volatile __m256i* widePtr = (__m256i*) linePtr;
+   auto start = std::chrono::high_resolution_clock::now();
+   for (uint64_t i = 0; i < iterations; ++i) {
+      if (access == mmioAccess::BYPASS_256) {
+         for (uint32_t w = 0; w < 2; ++w) {
+            widePtr[w] = _mm256_set1_epi64x(i + w);
+            if (fenceEachStore) {
+               _mm_sfence();
+            }
+         }
+      } else {
+         for (uint32_t w = 0; w < 8; ++w) {
+            linePtr[w] = htols(i + w);
+            if (fenceEachStore) {
+               _mm_sfence();
+            }
+         }
+      }
+      _mm_sfence();
+   }
+   _mm_mfence();
+   auto end = std::chrono::high_resolution_clock::now();
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count() / (double) iterations;
+}
+
 // optwriteReg functions aim to use one 256-bit transaction to write to XDMA-Bypass region 
 void FpgaController::optwriteReg(userCtrlAddr addr, uint32_t value)
 {
@@ -425,29 +634,113 @@ void FpgaController::optwriteReg(netCtrlAddr addr, __m256i* value, uint8_t port)
 
 }
 
-void FpgaController::optpostCmd(appOpCode op, roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr)
+void FpgaController::optwriteReg(dmaCtrlAddr addr, __m256i* value)
 {
-  // std::lock_guard<std::mutex> guard(ctrl_mutex);
-  // Declare the values to be written :   VAL write_values = {{op, pair->local.qpn, originAddr, targetAddr, size}};
+   volatile uint64_t* wPtr = (uint64_t*) (((uint64_t) by_base) + dmaRegAddressOffset +  ((uint64_t) addr << 5));
+
+   _mm256_store_si256 ((__m256i *) wPtr, (__m256i) *value);
+   _mm_mfence();
+}
+
+/*
+ * The hardware writes a completion per finished command and incoming write
+ * to the ring, a nullptr ring stops it.
+ */
+void FpgaController::setCompletionQueue(void* ring, uint32_t numEntries)
+{
+   std::lock_guard<std::mutex> guard(ctrl_mutex);
+   writeReg(netCtrlAddr::CQ, (uint32_t) (uint64_t) ring);
+   writeReg(netCtrlAddr::CQ, (uint32_t) (((uint64_t) ring) >> 32));
+   writeReg(netCtrlAddr::CQ, numEntries);
+}
 
-   //Check if not too many outstanding cmds
-   while (cmdCounter > (cmdFifoDepth - 10)) {
-      cmdCounter = readReg(netCtrlAddr::CMD_OUT);
-      if (cmdCounter > (cmdFifoDepth - 10)) {
-         std::cout << "cmd fifo full" << std::endl;
-         std::this_thread::sleep_for(std::chrono::microseconds(1));
+void FpgaController::writeCqHead(uint32_t head)
+{
+   writeReg(netCtrlAddr::CQ_HEAD, head);
+}
+
+/*
+ * Takes a ticket for a slot in the command fifo. A ticket is admitted once
+ * fewer than cmdFifoLimit commands are ahead of it that the hardware has not
+ * consumed, so posting threads never take a lock. Ordering is only kept
+ * between the commands of one thread. A waiting poster backs off
+ * exponentially and then yields.
+ */
+void FpgaController::reserveCmdSlot(uint32_t count)
+{
+   uint64_t ticket = cmdReserved.fetch_add(count, std::memory_order_relaxed);
+   uint32_t waits = 0;
+   while ((int64_t) (ticket + count - cmdConsumed.load(std::memory_order_acquire)) > (int64_t) cmdFifoLimit) {
+      if (refreshCmdConsumed()) {
+         continue;
+      }
+      if (waits < cmdSpinWaits) {
+         for (uint32_t i = 0; i < (1u << waits); ++i) {
+            _mm_pause();
+         }
+         waits++;
+      } else {
+         std::this_thread::yield();
+      }
+   }
+}
+
+/*
+ * Replenishes the credits from the credit word if the hardware writes one,
+ * otherwise from a read of the fifo level. Only one thread refreshes, the
+ * others wait for its result. Commands posted after cmdPosted is loaded only
+ * raise the level, so the consumed count derived from it is a lower bound.
+ */
+bool FpgaController::refreshCmdConsumed()
+{
+   if (cmdRefreshing.test_and_set(std::memory_order_acquire)) {
+      return false;
+   }
+   uint64_t consumed = 0;
+   if (creditWord != nullptr) {
+      consumed = *creditWord;
+   } else {
+      uint64_t posted = cmdPosted.load(std::memory_order_acquire);
+      uint32_t outstanding = readReg(netCtrlAddr::CMD_OUT);
+      if (outstanding <= posted) {
+         consumed = posted - outstanding;
       }
    }
+   uint64_t current = cmdConsumed.load(std::memory_order_relaxed);
+   while (consumed > current && !cmdConsumed.compare_exchange_weak(current, consumed, std::memory_order_release)) {}
+   bool progress = (consumed > current);
+   cmdRefreshing.clear(std::memory_order_release);
+   return progress;
+}
+
+/*
+ * The hardware writes its count of consumed commands to word, which has to
+ * be in the DMA region. nullptr stops the write back.
+ */
+void FpgaController::setCreditWord(volatile uint64_t* word)
+{
+   std::lock_guard<std::mutex> guard(ctrl_mutex);
+   if (word != nullptr) {
+      *word = 0;
+   }
+   writeReg(netCtrlAddr::CMD_CREDIT, (uint32_t) (uint64_t) word);
+   writeReg(netCtrlAddr::CMD_CREDIT, (uint32_t) (((uint64_t) word) >> 32));
+   creditWord = word;
+}
+
+void FpgaController::optpostCmd(appOpCode op, roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr, uint32_t tag)
+{
+  // Declare the values to be written :   VAL write_values = {{op, pair->local.qpn, originAddr, targetAddr, size}};
+
+   reserveCmdSlot();
 
 #ifdef JOIN_DEBUG_PRINT
    printf("postCmd, code: %i, originAddr: %lx, size: %u, targetAddr: %lx\n", op, originAddr, size, targetAddr);
 #endif
   
-   VAL write_values = {uint8_t(op), uint32_t(pair->local.qpn), uint64_t(originAddr), uint64_t(targetAddr), uint32_t(size)};
+   VAL write_values = {uint8_t(op), uint32_t(pair->local.qpn), uint64_t(originAddr), uint64_t(targetAddr), uint32_t(size), tag};
    optwriteReg(netCtrlAddr::POST, (__m256i*) &write_values);
-   
-   //update cmd counter atomic operation
-   cmdCounter++;
+   cmdPosted.fetch_add(1, std::memory_order_release);
 
 #ifdef IB_DEBUG
    std::cout << std::hex << "local vaddr: " << originAddr << std::endl;
@@ -457,15 +750,83 @@ void FpgaController::optpostCmd(appOpCode op, roce::QueuePair* pair, const void*
 #endif
 }
 
+static inline VAL descriptorVal(appOpCode op, uint32_t qpn, const PostDescriptor& desc)
+{
+   VAL write_values = {uint8_t(op), qpn, uint64_t(desc.originAddr), uint64_t(desc.targetAddr), desc.size, desc.tag};
+   return write_values;
+}
+
+#if defined(POST_WINDOW) && defined(HAVE_AVX512)
+static bool hasAvx512()
+{
+   static const bool supported = __builtin_cpu_supports("avx512f");
+   return supported;
+}
+
+//Both descriptors in one 64-byte store, which fills a write-combining buffer
+__attribute__((target("avx512f")))
+static void storeDescriptorPair(void* window, const VAL& first, const VAL& second)
+{
+   __m512i pair = _mm512_inserti64x4(_mm512_castsi256_si512(first.x), second.x, 1);
+   *((volatile __m512i*) window) = pair;
+}
+#endif
+
+/*
+ * Posts the commands in chunks of at most cmdBatchMax. The bypass region is
+ * mapped uncached, so the stores of a chunk reach the POST register in order
+ * without a fence in between, only the chunk is fenced once. On AVX-512 hosts
+ * with the post window mapped, two commands leave as one 64-byte write to the
+ * write-combining window. Every pair is fenced, so pairs stay in order and do
+ * not overwrite each other in the write-combining buffer.
+ */
+void FpgaController::optpostCmdBatch(appOpCode op, roce::QueuePair* pair, const PostDescriptor* descriptors, uint32_t count)
+{
+   uint32_t qpn = pair->local.qpn;
+   //volatile, the compiler must not merge the stores to the same address
+   volatile __m256i* wPtr = (volatile __m256i*) (((uint64_t) by_base) + netRegAddressOffset[0] + ((uint64_t) netCtrlAddr::POST << 5));
+   while (count > 0) {
+      uint32_t batch = std::min(count, cmdBatchMax);
+      reserveCmdSlot(batch);
+      uint32_t i = 0;
+#if defined(POST_WINDOW) && defined(HAVE_AVX512)
+      if (post_base != nullptr && hasAvx512()) {
+         for (; i + 1 < batch; i += 2) {
+            storeDescriptorPair(post_base, descriptorVal(op, qpn, descriptors[i]), descriptorVal(op, qpn, descriptors[i+1]));
+            _mm_sfence();
+         }
+      }
+#endif
+      for (; i < batch; ++i) {
+         *wPtr = descriptorVal(op, qpn, descriptors[i]).x;
+      }
+      _mm_sfence();
+      cmdPosted.fetch_add(batch, std::memory_order_release);
+      descriptors += batch;
+      count -= batch;
+   }
+}
+
 /*
  * RoCE
  */
 void FpgaController::writeContext(roce::QueuePair* pair)
 {
-   std::lock_guard<std::mutex> guard(ctrl_mutex);
 #ifdef IB_DEBUG
    printf("Writing context\n");
 #endif
+#ifdef BYPASS_PROGRAMMING
+   SETUP_VAL context = {{(uint32_t) qpState::RESET,
+                         (uint32_t) pair->local.qpn,
+                         (uint32_t) pair->remote.psn,
+                         (uint32_t) pair->local.psn,
+                         (uint32_t) pair->remote.rkey,
+                         (uint32_t) pair->remote.vaddr,
+                         (uint32_t) (pair->remote.vaddr >> 32),
+                         0}};
+   optwriteReg(netCtrlAddr::CTX, &context.x);
+#else
+   std::lock_guard<std::mutex> guard(ctrl_mutex);
    writeReg(netCtrlAddr::CTX, (uint8_t) qpState::RESET);
    writeReg(netCtrlAddr::CTX, (uint32_t) pair->local.qpn);
    writeReg(netCtrlAddr::CTX, (uint32_t) pair->remote.psn);
@@ -473,6 +834,7 @@ void FpgaController::writeContext(roce::QueuePair* pair)
    writeReg(netCtrlAddr::CTX, (uint32_t) pair->remote.rkey);
    writeReg(netCtrlAddr::CTX, (uint32_t) pair->remote.vaddr);
    writeReg(netCtrlAddr::CTX, ((uint32_t) (pair->remote.vaddr >> 32)));
+#endif
 
 #ifdef IB_DEBUG
    printf("done\n");
@@ -481,10 +843,21 @@ void FpgaController::writeContext(roce::QueuePair* pair)
 
 void FpgaController::writeConnection(roce::QueuePair* pair, int port)
 {
-   std::lock_guard<std::mutex> guard(ctrl_mutex);
 #ifdef IB_DEBUG
    printf("Writing connection\n");
 #endif
+#ifdef BYPASS_PROGRAMMING
+   SETUP_VAL connection = {{(uint32_t) pair->local.qpn,
+                            (uint32_t) pair->remote.qpn,
+                            htols(pair->remote.gidToUint(0)),
+                            htols(pair->remote.gidToUint(8)),
+                            htols(pair->remote.gidToUint(16)),
+                            htols(pair->remote.gidToUint(24)),
+                            (uint32_t) port,
+                            0}};
+   optwriteReg(netCtrlAddr::CONN, &connection.x);
+#else
+   std::lock_guard<std::mutex> guard(ctrl_mutex);
    writeReg(netCtrlAddr::CONN, (uint32_t) pair->local.qpn);
    writeReg(netCtrlAddr::CONN, (uint32_t) pair->remote.qpn);
 
@@ -501,20 +874,57 @@ void FpgaController::writeConnection(roce::QueuePair* pair, int port)
    writeReg(netCtrlAddr::CONN, writeVal);
 
    writeReg(netCtrlAddr::CONN, (uint32_t)port);
+#endif
 #ifdef IB_DEBUG
    printf("done\n");
 #endif
 }
 
-void FpgaController::postWrite(roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr)
+void FpgaController::postWrite(roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr, uint32_t tag)
 {
   // postCmd(appOpCode::APP_WRITE, pair, originAddr, size, targetAddr);
-   optpostCmd(appOpCode::APP_WRITE, pair, originAddr, size, targetAddr);
+   optpostCmd(appOpCode::APP_WRITE, pair, originAddr, size, targetAddr, tag);
+}
+
+/*
+ * All commands share the single-store bypass path, AXI_LITE_POST keeps the
+ * register path for commands other than writes
+ */
+void FpgaController::postRead(roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr, uint32_t tag)
+{
+#ifdef AXI_LITE_POST
+   postCmd(appOpCode::APP_READ, pair, originAddr, size, targetAddr, tag);
+#else
+   optpostCmd(appOpCode::APP_READ, pair, originAddr, size, targetAddr, tag);
+#endif
+}
+
+void FpgaController::postReadConsistent(roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr, uint32_t tag)
+{
+#ifdef AXI_LITE_POST
+   postCmd(appOpCode::APP_READ_CONSISTENT, pair, originAddr, size, targetAddr, tag);
+#else
+   optpostCmd(appOpCode::APP_READ_CONSISTENT, pair, originAddr, size, targetAddr, tag);
+#endif
 }
 
-void FpgaController::postRead(roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr)
+void FpgaController::postPointer(roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr, uint32_t tag)
 {
-   postCmd(appOpCode::APP_READ, pair, originAddr, size, targetAddr);
+#ifdef AXI_LITE_POST
+   postCmd(appOpCode::APP_POINTER, pair, originAddr, size, targetAddr, tag);
+#else
+   optpostCmd(appOpCode::APP_POINTER, pair, originAddr, size, targetAddr, tag);
+#endif
+}
+
+void FpgaController::postWriteBatch(roce::QueuePair* pair, const PostDescriptor* descriptors, uint32_t count)
+{
+   optpostCmdBatch(appOpCode::APP_WRITE, pair, descriptors, count);
+}
+
+void FpgaController::postReadBatch(roce::QueuePair* pair, const PostDescriptor* descriptors, uint32_t count)
+{
+   optpostCmdBatch(appOpCode::APP_READ, pair, descriptors, count);
 }
 
 /*void FpgaController::postPart(roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr)
@@ -522,22 +932,15 @@ void FpgaController::postRead(roce::QueuePair* pair, const void* originAddr, uin
    postCmd(appOpCode::APP_PART, pair, originAddr, size, targetAddr);
 }*/
 
-void FpgaController::postCmd(appOpCode op, roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr)
+void FpgaController::postCmd(appOpCode op, roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr, uint32_t tag)
 {
-   std::lock_guard<std::mutex> guard(ctrl_mutex);
-
-   //Check if not too many outstanding cmds
-   while (cmdCounter > (cmdFifoDepth - 10)) {
-      cmdCounter = readReg(netCtrlAddr::CMD_OUT);
-      if (cmdCounter > (cmdFifoDepth - 10)) {
-         std::cout << "cmd fifo full" << std::endl;
-         std::this_thread::sleep_for(std::chrono::microseconds(1));
-      }
-   }
+   reserveCmdSlot();
 
 #ifdef JOIN_DEBUG_PRINT
    printf("postCmd, code: %i, originAddr: %lx, size: %u, targetAddr: %lx\n", op, originAddr, size, targetAddr);
 #endif
+   //The words of one command must not interleave with another thread's
+   std::unique_lock<std::mutex> guard(ctrl_mutex);
 #ifdef LEGACY_POST
    // one writeReg -> one AXI Lite transaction 
    writeReg(netCtrlAddr::POST, (uint32_t)((((uint32_t)op) << 24) | (pair->local.qpn & 0xFFFFFF)));
@@ -553,8 +956,11 @@ void FpgaController::postCmd(appOpCode op, roce::QueuePair* pair, const void* or
    writeReg(netCtrlAddr::POST, (((uint64_t) targetAddr) >> 16)); 
    writeReg(netCtrlAddr::POST, (uint32_t) (size & 0xFFFFFFF8) | (((uint32_t) op) & 0x7));
 #endif
-   //update cmd counter
-   cmdCounter++;
+#ifdef COMPLETION_QUEUE
+   writeReg(netCtrlAddr::POST, tag);
+#endif
+   guard.unlock();
+   cmdPosted.fetch_add(1, std::memory_order_release);
 
    #ifdef IB_DEBUG
    std::cout << std::hex << "local vaddr: " << originAddr << std::endl;
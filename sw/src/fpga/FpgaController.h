@@ -36,8 +36,10 @@
 #include <inttypes.h>
 #include <cstdint>
 #include <string>
+#include <vector>
 #include <mutex>
 #include <atomic>
+#include <chrono>
 
 #include <sys/types.h>
 #include <sys/mman.h>
@@ -69,6 +71,9 @@ enum class direction : uint8_t { RX=0, TX=1 };
 enum class PredicateOp : uint8_t {EQUAL=0, LESSTHAN=1, GREATERTHAN=2, NOTEQUAL=3};
 
 enum class memoryOp : uint8_t { READ=0, WRITE=1 };
+enum class benchmarkType : uint8_t { DMA=0, DRAM=1, IPERF=2 };
+enum class mmioAccess : uint8_t { AXILITE=0, BYPASS_64=1, BYPASS_256=2 };
+enum class mmioFence : uint8_t { NONE=0, SFENCE=1, MFENCE=2 };
 
 enum class userCtrlAddr : uint32_t { IPERF_BENCH = 0,
                                      IPERF_ADDR = 1,
@@ -85,6 +90,7 @@ enum class userCtrlAddr : uint32_t { IPERF_BENCH = 0,
                                      MEM_SIZE = 8,
                                      AGG_OP = 9,
                                      AGG_DONE = 10,
+                                     SCRATCH = 11,
                                      IPERF_CYCLES = 12,
                                      DDR_BENCH_CYCLES = 13,
                                      DMA_BENCH_CYCLES = 14,
@@ -102,6 +108,7 @@ static const std::string RegNames[] = {"TLB Miss counter",
 
 enum class dmaCtrlAddr : uint32_t { TLB = 2,
                                  //DMA_BENCH = 3,
+                                 TLB_BULK = 4, //not decoded by the shell yet
                                  //BOARDNUM = 7,
                                  //IPADDR = 8,
                                  DMA_READS = 10,
@@ -148,9 +155,12 @@ enum class netCtrlAddr: uint32_t { CTX = 0,
                                  BOARDNUM = 7,
                                  IPADDR = 8,
                                  ARP = 9,
+                                 CMD_CREDIT = 10,
                                  STATS = 12,
                                  CMD_OUT = 14,
                                  PC_META = 15,
+                                 CQ = 16,
+                                 CQ_HEAD = 17,
                               };
 static const uint32_t numNetStatsRegs = 25;
 static const std::string NetRegNames[] = {"CRC drops",
@@ -180,6 +190,16 @@ static const std::string NetRegNames[] = {"CRC drops",
                                           "down"
                                           };
 
+/*
+ * One read of the DMA and network STATS registers, indexed like DmaRegNames
+ * and NetRegNames. The counters are 32 bit and wrap around.
+ */
+struct CounterSnapshot {
+   std::chrono::steady_clock::time_point time;
+   uint32_t dma[numDmaStatsRegs];
+   uint32_t net[numNetStatsRegs];
+};
+
 enum class mmCtrlAddr: uint32_t { TEST   = 0,
                                   TEST_2 = 1,                                 
                               };                                          
@@ -192,6 +212,11 @@ static const uint64_t netRegAddressOffset[] = {16384};                         /
 static const uint64_t mmRegAddressOffset = 0;                                  // bypass space
 
 static const uint32_t cmdFifoDepth = 512;
+static const uint32_t cmdFifoLimit = cmdFifoDepth - 10;
+static const uint32_t cmdSpinWaits = 8; //Backoff rounds before a waiting poster yields
+static const uint32_t cmdBatchMax = 64; //Commands posted between two fences
+static const uint64_t benchmarkClearUs = 100; //Time until a start clears the cycle register
+static const uint64_t benchmarkMaxPollUs = 1000;
 
 union VAL{
    struct {
@@ -200,10 +225,31 @@ union VAL{
           uint64_t originAddr;
           uint64_t targetAddr;
           uint32_t size;  
+          uint32_t tag;  //returned in the completion entry
    };
    __m256i x;
 };   
 
+/*
+ * One command of a batch, posted in order like single commands
+ */
+struct PostDescriptor {
+   const void* originAddr;
+   const void* targetAddr;
+   uint32_t size;
+   uint32_t tag;
+};
+
+/*
+ * Register words of a context, connection or TLB entry, packed into one
+ * 256-bit write to the bypass region. Word i is what the i-th 32-bit write
+ * to the AXI-Lite register would have carried.
+ */
+union SETUP_VAL {
+   uint32_t words[8];
+   __m256i  x;
+};
+
 class FpgaController
 {
    public:
@@ -215,6 +261,11 @@ class FpgaController
          return instance;
       }*/
       void writeTlb(unsigned long vaddr, unsigned long paddr, bool isBase);
+      void setCreditWord(volatile uint64_t* word);
+#ifdef TLB_BULK_LOAD
+      void writeTlbBulk(unsigned long vaddr, unsigned long tablePaddr, uint32_t numEntries, bool isBase);
+      uint32_t getTlbBulkEntries();
+#endif
       uint64_t runDmaSeqWriteBenchmark(uint64_t baseAddr, uint64_t memorySize, uint32_t numberOfAcceses, uint32_t chunkLength);
       uint64_t runDmaSeqReadBenchmark(uint64_t baseAddr, uint64_t memorySize, uint32_t numberOfAcceses, uint32_t chunkLength);
       uint64_t runDmaRandomWriteBenchmark(uint64_t baseAddr, uint64_t memorySize, uint32_t numberOfAcceses, uint32_t chunkLength, uint32_t strideLength);
@@ -226,13 +277,26 @@ class FpgaController
       uint64_t runDramRandomReadBenchmark(uint64_t baseAddr, uint64_t memorySize, uint32_t numberOfAcceses, uint32_t chunkLength, uint32_t strideLength, uint8_t channel);
 
       uint64_t runIperfBenchmark(bool dualMode, uint16_t numConn, uint8_t wordCount, uint8_t packetGap, uint32_t timeINHectoSeconds, uint64_t timeInCycles);
+
+      //Non-blocking benchmarks, one of each type can run at a time
+      void startDmaBenchmark(uint64_t baseAddr, uint64_t memorySize, uint32_t numberOfAccesses, uint32_t chunkLength, uint32_t strideLength, memoryOp op);
+      void startDramBenchmark(uint64_t baseAddr, uint64_t memorySize, uint32_t numberOfAccesses, uint32_t chunkLength, uint32_t strideLength, memoryOp op, uint8_t channel);
+      void startIperfBenchmark(bool dualMode, uint16_t numConn, uint8_t wordCount, uint8_t packetGap, uint32_t timeInHectoSeconds, uint64_t timeInCycles);
+      bool pollBenchmark(benchmarkType type, uint64_t& cycles);
+      uint64_t waitBenchmark(benchmarkType type);
       void setIperfAddress(uint8_t number, uint32_t address);
 
       //RoCE
       void writeContext(roce::QueuePair* par);
       void writeConnection(roce::QueuePair *par, int port);
-      void postWrite(roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr);
-      void postRead(roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr);
+      void postWrite(roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr, uint32_t tag=0);
+      void postRead(roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr, uint32_t tag=0);
+      void postReadConsistent(roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr, uint32_t tag=0);
+      void postPointer(roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr, uint32_t tag=0);
+      void postWriteBatch(roce::QueuePair* pair, const PostDescriptor* descriptors, uint32_t count);
+      void postReadBatch(roce::QueuePair* pair, const PostDescriptor* descriptors, uint32_t count);
+      void setCompletionQueue(void* ring, uint32_t numEntries);
+      void writeCqHead(uint32_t head);
       
       //Network
       void setIpAddr(uint32_t addr);
@@ -247,6 +311,12 @@ class FpgaController
       void printDmaStatsRegs();
       void printDdrStatsRegs(uint8_t channel);
       void printNetStatsRegs(uint8_t port=0);
+      CounterSnapshot readCounters(uint8_t port=0);
+
+      //MMIO microbenchmarks on the scratch and TEST registers, return ns per operation
+      double runMmioWriteBenchmark(mmioAccess access, mmioFence fence, uint64_t iterations);
+      void runMmioReadBenchmark(mmioAccess access, bool afterWrite, std::vector<double>& latencies);
+      double runMmioLineBenchmark(mmioAccess access, bool fenceEachStore, uint64_t iterations);
 
      private:
       uint64_t runDmaBenchmark(uint64_t baseAddr, uint64_t memorySize, uint32_t  numberOfAccesses, uint32_t chunkLength, uint32_t strideLength, memoryOp op);
@@ -263,6 +333,7 @@ class FpgaController
       void optwriteReg(userCtrlAddr, uint32_t value);
       void optwriteReg(dmaCtrlAddr, uint32_t value);
       void optwriteReg(netCtrlAddr, __m256i* value, uint8_t port=0);
+      void optwriteReg(dmaCtrlAddr, __m256i* value);
 
       uint32_t readReg(userCtrlAddr addr);
       uint32_t readReg(dmaCtrlAddr addr);
@@ -272,8 +343,13 @@ class FpgaController
       void writeMM(mmCtrlAddr, uint64_t value);
       uint64_t readMM(mmCtrlAddr addr);
 
-      void postCmd(appOpCode op, roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr);
-      void optpostCmd(appOpCode op, roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr);
+      void prepareBenchmark(benchmarkType type);
+      uint64_t readCycles(benchmarkType type);
+      void reserveCmdSlot(uint32_t count=1);
+      bool refreshCmdConsumed();
+      void postCmd(appOpCode op, roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr, uint32_t tag=0);
+      void optpostCmd(appOpCode op, roce::QueuePair* pair, const void* originAddr, uint32_t size, const void* targetAddr, uint32_t tag=0);
+      void optpostCmdBatch(appOpCode op, roce::QueuePair* pair, const PostDescriptor* descriptors, uint32_t count);
 
    public:
       FpgaController(FpgaController const&)     = delete;
@@ -281,9 +357,17 @@ class FpgaController
    private:
    void*  m_base;
    void*  by_base;
-
-   static std::atomic_uint cmdCounter;  //std::atomic<unsigned int>
-   //static uint32_t cmdCounter;
+   void*  post_base; //write-combining post window, nullptr if not mapped
+
+   //Slots of the command fifo, tickets are taken without a lock
+   std::atomic<uint64_t> cmdReserved;
+   std::atomic<uint64_t> cmdPosted;
+   std::atomic<uint64_t> cmdConsumed;
+   std::atomic_flag cmdRefreshing = ATOMIC_FLAG_INIT;
+   //Written by the hardware with the number of consumed commands
+   volatile uint64_t* creditWord;
+   uint64_t benchmarkPrevious[3];
+   std::chrono::high_resolution_clock::time_point benchmarkStart[3];
    static std::mutex  ctrl_mutex;
    static std::mutex  btree_mutex;
 
@@ -26,67 +26,856 @@
  */
 
 #include "MemoryManager.h"
+#include "ThreadCache.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 namespace fpga {
 
-MemoryManager::MemoryManager(void* _base, size_t _size) {
+static inline uint32_t log2Floor(uint64_t value) {
+   return 63 - __builtin_clzll(value);
+}
+
+static void* reserveMetadata(size_t bytes) {
+   void* ptr = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+   if (ptr == MAP_FAILED) {
+      std::cerr << "[ERROR] on mmap of memory manager metadata" << std::endl;
+      exit(1);
+   }
+   return ptr;
+}
+
+MemoryManager::MemoryManager(void* _base, size_t _size, bool isZeroed, size_t maxSize) {
    base = _base;
    size = _size;
+   numPages = size / SMALL_PAGE_SIZE;
+   maxPages = (maxSize > size) ? (maxSize / SMALL_PAGE_SIZE) : numPages;
+   zeroingEnabled = false;
+   hugePageBoundary = 0;
+   growZeroed = false;
+   growing = false;
+   growthRequest = 0;
    printf("memory manager init, base: %p, size: %lu\n", base, size);
-   memset(base, 0, size);
-   chunks = new MemChunk((unsigned char*) base, size);
+
+   //The metadata is reserved for maxSize, untouched pages of it cost no memory
+   pages = (PageInfo*) reserveMetadata(maxPages * sizeof(PageInfo));
+   dirtyBitmap = (uint64_t*) reserveMetadata(((maxPages + 63) / 64) * sizeof(uint64_t));
+   dirtyFreeBlocks = NONE;
+   cleanFrom = 0;
+   cleanTo = 0;
+   if (!isZeroed) {
+      setDirty(0, numPages, true);
+   }
+   for (uint32_t i = 0; i < NUM_BINS; ++i) {
+      freeLists[i] = NONE;
+   }
+   memset(binBitmap, 0, sizeof(binBitmap));
+   for (uint32_t tag = 0; tag < MAX_TAGS; ++tag) {
+      for (uint32_t i = 0; i < NUM_SIZE_CLASSES; ++i) {
+         partialSlabs[tag][i] = NONE;
+      }
+      tagBytesInUse[tag] = 0;
+   }
+   bytesInUse = 0;
+   cachedBytes = 0;
+   highWaterMark = 0;
+   slabPages = 0;
+   allocations = 0;
+   failedAllocations = 0;
+   if (numPages > 0) {
+      insertFreeBlock(0, numPages, !isZeroed);
+   }
 }
 
 MemoryManager::~MemoryManager() {
-   MemChunk* current = chunks;
-   MemChunk* next = chunks;
+   stopZeroing();
+   ThreadCache::release(this);
+   munmap(pages, maxPages * sizeof(PageInfo));
+   munmap(dirtyBitmap, ((maxPages + 63) / 64) * sizeof(uint64_t));
+}
 
-   do {
-      current = next;
-      next = current->next;
-      delete current;
-   } while(next != nullptr);
+/*
+ * Dirty pages of large chunks are zeroed after the lock is released, the
+ * chunk already belongs to the caller
+ */
+void* MemoryManager::allocate(size_t allocSize, bool zero, size_t alignment, uint8_t tag) {
+   PageRuns deferredZeroing;
+   void* ptr = nullptr;
+   {
+      std::unique_lock<std::mutex>  lock(this->memoryMutex);
+      size_t growth = 0;
+      ptr = allocateLocked(allocSize, zero, alignment, tag, &deferredZeroing, &growth);
+      while (ptr == nullptr && growth != 0) {
+         bool grown = growUnlocked(lock, growth);
+         growth = 0;
+         ptr = allocateLocked(allocSize, zero, alignment, tag, &deferredZeroing, grown ? &growth : nullptr);
+      }
+   }
+   zeroRuns(deferredZeroing);
+   return ptr;
 }
 
-void* MemoryManager::allocate(size_t allocSize) {
+void MemoryManager::free(void* ptr) {
    std::lock_guard<std::mutex>   lock(this->memoryMutex);
-   MemChunk* current = chunks;
-   bool exp = true;
-   size_t roundedSize = ((allocSize + 4095) / 4096) * 4096;
-   do {
-      if (current->free && roundedSize <= current->size) {
-         //Try to acquire
-         if (current->free.compare_exchange_weak(exp, false)) {
-            //Split chunk if possible)
-            if (current->size > roundedSize) {
-               MemChunk* nchunk = new MemChunk(current->addr+roundedSize, current->size-roundedSize);
-               current->size = roundedSize;
-               nchunk->next = current->next;
-               current->next = nchunk;
+   freeLocked(ptr);
+   if (zeroingEnabled) {
+      zeroingCondition.notify_one();
+   }
+}
+
+size_t MemoryManager::allocateBatch(size_t allocSize, void** chunks, size_t count, bool zero) {
+   PageRuns deferredZeroing;
+   size_t allocated = 0;
+   {
+      std::unique_lock<std::mutex>  lock(this->memoryMutex);
+      while (allocated < count) {
+         size_t growth = 0;
+         void* ptr = allocateLocked(allocSize, zero, 0, 0, &deferredZeroing, &growth);
+         while (ptr == nullptr && growth != 0) {
+            bool grown = growUnlocked(lock, growth);
+            growth = 0;
+            ptr = allocateLocked(allocSize, zero, 0, 0, &deferredZeroing, grown ? &growth : nullptr);
+         }
+         if (ptr == nullptr) {
+            break;
+         }
+         chunks[allocated++] = ptr;
+      }
+   }
+   zeroRuns(deferredZeroing);
+   return allocated;
+}
+
+void MemoryManager::freeBatch(void** chunks, size_t count) {
+   std::lock_guard<std::mutex>   lock(this->memoryMutex);
+   for (size_t i = 0; i < count; ++i) {
+      freeLocked(chunks[i]);
+   }
+   if (zeroingEnabled) {
+      zeroingCondition.notify_one();
+   }
+}
+
+/*
+ * Does not take the lock, the metadata of a chunk does not change while it
+ * is allocated.
+ */
+size_t MemoryManager::usableSize(void* ptr) const {
+   uint64_t offset = ((unsigned char*) ptr) - ((unsigned char*) base);
+   if (ptr < base || offset >= ((uint64_t) numPages) * SMALL_PAGE_SIZE) {
+      return 0;
+   }
+   const PageInfo& info = pages[offset / SMALL_PAGE_SIZE];
+   if (info.state == pageState::SLAB) {
+      return MIN_SLAB_OBJECT << info.sizeClass;
+   }
+   if (info.state == pageState::USED && info.isHead) {
+      return ((uint64_t) info.blockPages) * SMALL_PAGE_SIZE;
+   }
+   return 0;
+}
+
+uint8_t MemoryManager::chunkTag(void* ptr) const {
+   uint64_t offset = ((unsigned char*) ptr) - ((unsigned char*) base);
+   if (ptr < base || offset >= ((uint64_t) numPages) * SMALL_PAGE_SIZE) {
+      return 0;
+   }
+   return pages[offset / SMALL_PAGE_SIZE].tag;
+}
+
+/*
+ * With growth set, an allocation that needs the region to grow fails quietly
+ * and stores the bytes to grow by in growth, the caller grows without the
+ * lock and retries.
+ */
+void* MemoryManager::allocateLocked(size_t allocSize, bool zero, size_t alignment, uint8_t tag, PageRuns* deferredZeroing, size_t* growth) {
+   growthRequest = 0;
+   if (alignment & (alignment - 1)) {
+      std::cerr << "Alignment " << alignment << " is not a power of two" << std::endl;
+      return nullptr;
+   }
+   if (tag >= MAX_TAGS) {
+      std::cerr << "Tag " << (uint32_t) tag << " is out of range" << std::endl;
+      return nullptr;
+   }
+   //Buddy-style placement: chunks up to the boundary are aligned to their
+   //size rounded to a power of two and can therefore never straddle it
+   if (hugePageBoundary != 0) {
+      uint64_t placement = hugePageBoundary;
+      if (allocSize <= hugePageBoundary) {
+         placement = (allocSize <= 1) ? 1 : (1ULL << (log2Floor(allocSize - 1) + 1));
+      }
+      if (placement > alignment) {
+         alignment = placement;
+      }
+   }
+
+   if (allocSize <= MAX_SLAB_OBJECT && alignment <= MAX_SLAB_OBJECT) {
+      uint32_t cls = sizeClass(allocSize);
+      if (alignment > (MIN_SLAB_OBJECT << cls)) {
+         cls = sizeClass(alignment);
+      }
+      void* ptr = allocateObject(cls, zero, tag);
+      if (ptr == nullptr && growth != nullptr && growthRequest != 0) {
+         *growth = growthRequest;
+         return nullptr;
+      }
+      if (ptr == nullptr) {
+         failedAllocations++;
+         std::cerr << "Could not allocate chunk of size: " << allocSize << ", in use: " << bytesInUse
+                   << ", largest free block: " << largestFreeBlock() << std::endl;
+         return nullptr;
+      }
+      countUsed(tag, MIN_SLAB_OBJECT << cls);
+      return ptr;
+   }
+
+   uint64_t roundedPages = (allocSize + SMALL_PAGE_SIZE - 1) / SMALL_PAGE_SIZE;
+   uint64_t alignPages = (alignment > SMALL_PAGE_SIZE) ? (alignment / SMALL_PAGE_SIZE) : 1;
+   uint32_t page = NONE;
+   if (roundedPages <= maxPages && alignPages <= maxPages) {
+      page = allocatePages(roundedPages, alignPages);
+   }
+   if (page == NONE && growth != nullptr && growthRequest != 0) {
+      *growth = growthRequest;
+      return nullptr;
+   }
+   if (page == NONE) {
+      failedAllocations++;
+      std::cerr << "Could not allocate chunk of size: " << roundedPages * SMALL_PAGE_SIZE << ", in use: " << bytesInUse
+                << ", largest free block: " << largestFreeBlock() << std::endl;
+      return nullptr;
+   }
+   pages[page].tag = tag;
+   countUsed(tag, roundedPages * SMALL_PAGE_SIZE);
+   if (zero) {
+      if (deferredZeroing != nullptr && roundedPages > ZEROING_BATCH_PAGES) {
+         takeDirty(page, page + roundedPages, *deferredZeroing);
+      } else {
+         zeroDirty(page, page + roundedPages, roundedPages);
+      }
+   }
+   return ((unsigned char*) base) + ((uint64_t) page) * SMALL_PAGE_SIZE;
+}
+
+void MemoryManager::freeLocked(void* ptr) {
+   uint64_t offset = ((unsigned char*) ptr) - ((unsigned char*) base);
+   if (ptr < base || offset >= ((uint64_t) numPages) * SMALL_PAGE_SIZE) {
+      std::cerr << "Could not free chunk at " << ptr << ", not in DMA region" << std::endl;
+      return;
+   }
+
+   uint32_t page = offset / SMALL_PAGE_SIZE;
+   PageInfo& info = pages[page];
+   if (info.state == pageState::SLAB) {
+      freeObject(page, offset % SMALL_PAGE_SIZE);
+   } else if (info.state == pageState::USED && info.isHead && (offset % SMALL_PAGE_SIZE) == 0) {
+      countUsed(info.tag, -((int64_t) info.blockPages) * SMALL_PAGE_SIZE);
+      setDirty(page, page + info.blockPages, true);
+      freePages(page);
+   } else {
+      std::cerr << "Could not free chunk at " << ptr << ", not allocated" << std::endl;
+   }
+}
+
+void MemoryManager::setHugePageBoundary(uint64_t boundary) {
+   std::lock_guard<std::mutex>   lock(this->memoryMutex);
+   hugePageBoundary = boundary;
+}
+
+void MemoryManager::setGrowHandler(GrowHandler handler, bool isZeroed) {
+   std::lock_guard<std::mutex>   lock(this->memoryMutex);
+   growHandler = handler;
+   growZeroed = isZeroed;
+}
+
+/*
+ * Adds memory directly behind the region. Allocated chunks do not move, so
+ * this is safe while DMA on them is in flight.
+ */
+bool MemoryManager::grow(size_t additionalSize, bool isZeroed) {
+   std::lock_guard<std::mutex>   lock(this->memoryMutex);
+   return growLocked(additionalSize, isZeroed);
+}
+
+/*
+ * Caller holds the lock. Runs the grow handler without it, one thread at a
+ * time, and publishes the new pages afterwards. A thread that finds a grow
+ * in progress waits for it and retries its allocation.
+ */
+bool MemoryManager::growUnlocked(std::unique_lock<std::mutex>& lock, size_t required) {
+   if (growing) {
+      growCondition.wait(lock, [this]() { return !growing; });
+      return true;
+   }
+   growing = true;
+   GrowHandler handler = growHandler;
+   bool isZeroed = growZeroed;
+   lock.unlock();
+   size_t added = handler(required);
+   lock.lock();
+   growing = false;
+   bool grown = growLocked(added, isZeroed);
+   growCondition.notify_all();
+   return grown;
+}
+
+bool MemoryManager::growLocked(size_t additionalSize, bool isZeroed) {
+   uint64_t addedPages = additionalSize / SMALL_PAGE_SIZE;
+   if (addedPages == 0 || ((uint64_t) numPages) + addedPages > maxPages) {
+      return false;
+   }
+   uint32_t first = numPages;
+   numPages += addedPages;
+   size += addedPages * SMALL_PAGE_SIZE;
+   if (!isZeroed) {
+      setDirty(first, numPages, true);
+   }
+   //Release the new pages as one block so they merge with a free tail
+   setBlock(first, addedPages, pageState::USED);
+   freePages(first, !isZeroed);
+   printf("memory manager grown, size: %lu\n", size);
+   if (zeroingEnabled) {
+      zeroingCondition.notify_one();
+   }
+   return true;
+}
+
+/*
+ * Bins 1 to SL_COUNT-1 hold blocks of exactly that many pages, above that
+ * every power of two is split into SL_COUNT linear sub-bins.
+ */
+uint32_t MemoryManager::binIndex(uint32_t numPages) {
+   if (numPages < SL_COUNT) {
+      return numPages;
+   }
+   uint32_t fl = log2Floor(numPages);
+   uint32_t sl = (numPages >> (fl - SL_LOG2)) - SL_COUNT;
+   return (fl - SL_LOG2 + 1) * SL_COUNT + sl;
+}
+
+uint32_t MemoryManager::sizeClass(size_t size) {
+   if (size <= MIN_SLAB_OBJECT) {
+      return 0;
+   }
+   return log2Floor(size - 1) + 1 - log2Floor(MIN_SLAB_OBJECT);
+}
+
+//Records in growthRequest how much the region has to grow if nothing fits
+uint32_t MemoryManager::allocatePages(uint32_t numPages, uint32_t alignPages) {
+   uint32_t page = takeFreePages(numPages, alignPages);
+   if (page == NONE && growHandler && numPages < maxPages - this->numPages) {
+      //Enough for the block and its worst-case alignment gap
+      growthRequest = (((uint64_t) numPages) + alignPages - 1) * SMALL_PAGE_SIZE;
+   }
+   return page;
+}
+
+uint32_t MemoryManager::takeFreePages(uint32_t numPages, uint32_t alignPages) {
+   //Round up to the next bin so that every block in the bin fits, including
+   //the worst-case alignment gap
+   uint64_t searchPages = ((uint64_t) numPages) + alignPages - 1;
+   if (searchPages >= SL_COUNT) {
+      searchPages += (1ULL << (log2Floor(searchPages) - SL_LOG2)) - 1;
+   }
+   uint32_t page = NONE;
+   if (searchPages <= 0xFFFFFFFF) {
+      page = findFreeBlock(binIndex(searchPages));
+   }
+   //Fall back to checking every block that might fit
+   if (page == NONE) {
+      for (uint32_t bin = binIndex(numPages); bin < NUM_BINS && page == NONE; ++bin) {
+         if (!(binBitmap[bin / 64] & (1ULL << (bin % 64)))) {
+            continue;
+         }
+         for (uint32_t candidate = freeLists[bin]; candidate != NONE; candidate = pages[candidate].next) {
+            if (((uint64_t) alignmentGap(candidate, alignPages)) + numPages <= pages[candidate].blockPages) {
+               page = candidate;
+               break;
             }
-            return current->addr;
          }
       }
-      current = current->next;
-   } while(current != nullptr);
+   }
+   if (page == NONE) {
+      return NONE;
+   }
 
-   std::cerr << "Could not allocate chunk of size: " << roundedSize << std::endl;
-   return nullptr;
+   uint32_t blockPages = pages[page].blockPages;
+   uint32_t gap = alignmentGap(page, alignPages);
+   bool isDirty = removeFreeBlock(page);
+   if (gap > 0) {
+      insertFreeBlock(page, gap, isDirty);
+      page += gap;
+      blockPages -= gap;
+   }
+   if (blockPages > numPages) {
+      insertFreeBlock(page + numPages, blockPages - numPages, isDirty);
+   }
+   setBlock(page, numPages, pageState::USED);
+   return page;
 }
 
-void MemoryManager::free(void* ptr) {
-   //TODO merge
-   MemChunk* current = chunks;
-   do {
-      if (current->addr == ptr) {
-         memset(current->addr, 0, current->size);
-         current->free = true;
-      }
-      current = current->next;
-   } while(current != nullptr);
+uint32_t MemoryManager::findFreeBlock(uint32_t bin) {
+   for (uint32_t word = bin / 64; word < (NUM_BINS + 63) / 64; ++word) {
+      uint64_t mask = binBitmap[word];
+      if (word == bin / 64) {
+         mask &= ~0ULL << (bin % 64);
+      }
+      if (mask != 0) {
+         return freeLists[word * 64 + __builtin_ctzll(mask)];
+      }
+   }
+   return NONE;
+}
+
+//Number of pages to skip from page to reach an address aligned to alignPages
+uint32_t MemoryManager::alignmentGap(uint32_t page, uint32_t alignPages) const {
+   uint64_t alignment = ((uint64_t) alignPages) * SMALL_PAGE_SIZE;
+   uint64_t addr = ((uint64_t) base) + ((uint64_t) page) * SMALL_PAGE_SIZE;
+   return ((alignment - (addr % alignment)) % alignment) / SMALL_PAGE_SIZE;
+}
+
+void MemoryManager::freePages(uint32_t page, bool isDirty) {
+   uint32_t blockPages = pages[page].blockPages;
+   setBlock(page, blockPages, pageState::INTERIOR);
+
+   //Merge with right neighbour
+   uint32_t right = page + blockPages;
+   if (right < numPages && pages[right].state == pageState::FREE) {
+      uint32_t rightPages = pages[right].blockPages;
+      isDirty |= removeFreeBlock(right);
+      setBlock(right, rightPages, pageState::INTERIOR);
+      blockPages += rightPages;
+   }
+   //Merge with left neighbour
+   if (page > 0 && pages[page-1].state == pageState::FREE) {
+      uint32_t leftPages = pages[page-1].blockPages;
+      uint32_t left = page - leftPages;
+      isDirty |= removeFreeBlock(left);
+      setBlock(left, leftPages, pageState::INTERIOR);
+      blockPages += leftPages;
+      page = left;
+   }
+   insertFreeBlock(page, blockPages, isDirty);
+}
+
+void MemoryManager::setBlock(uint32_t page, uint32_t blockPages, pageState state) {
+   uint32_t last = page + blockPages - 1;
+   pages[page].blockPages = blockPages;
+   pages[page].state = state;
+   pages[page].isHead = true;
+   if (last != page) {
+      pages[last].blockPages = blockPages;
+      pages[last].state = state;
+      pages[last].isHead = false;
+   }
+}
+
+void MemoryManager::insertFreeBlock(uint32_t page, uint32_t blockPages, bool isDirty) {
+   setBlock(page, blockPages, pageState::FREE);
+   uint32_t bin = binIndex(blockPages);
+   pages[page].prev = NONE;
+   pages[page].next = freeLists[bin];
+   if (freeLists[bin] != NONE) {
+      pages[freeLists[bin]].prev = page;
+   }
+   freeLists[bin] = page;
+   binBitmap[bin / 64] |= (1ULL << (bin % 64));
+
+   pages[page].onDirtyList = isDirty;
+   if (isDirty) {
+      pages[page].dirtyPrev = NONE;
+      pages[page].dirtyNext = dirtyFreeBlocks;
+      if (dirtyFreeBlocks != NONE) {
+         pages[dirtyFreeBlocks].dirtyPrev = page;
+      }
+      dirtyFreeBlocks = page;
+   }
+}
+
+//Returns whether the block may have held dirty pages
+bool MemoryManager::removeFreeBlock(uint32_t page) {
+   PageInfo& info = pages[page];
+   uint32_t bin = binIndex(info.blockPages);
+   if (info.prev != NONE) {
+      pages[info.prev].next = info.next;
+   } else {
+      freeLists[bin] = info.next;
+      if (info.next == NONE) {
+         binBitmap[bin / 64] &= ~(1ULL << (bin % 64));
+      }
+   }
+   if (info.next != NONE) {
+      pages[info.next].prev = info.prev;
+   }
+   //Mark as taken so that neighbours do not merge with it
+   setBlock(page, info.blockPages, pageState::USED);
+
+   bool isDirty = info.onDirtyList;
+   if (isDirty) {
+      if (info.dirtyPrev != NONE) {
+         pages[info.dirtyPrev].dirtyNext = info.dirtyNext;
+      } else {
+         dirtyFreeBlocks = info.dirtyNext;
+      }
+      if (info.dirtyNext != NONE) {
+         pages[info.dirtyNext].dirtyPrev = info.dirtyPrev;
+      }
+      info.onDirtyList = false;
+   }
+   return isDirty;
+}
+
+/*
+ * Slabs
+ */
+void* MemoryManager::allocateObject(uint32_t cls, bool zero, uint8_t tag) {
+   uint32_t page = partialSlabs[tag][cls];
+   if (page == NONE) {
+      page = allocatePages(1, 1);
+      if (page == NONE) {
+         return nullptr;
+      }
+      uint32_t numObjects = SMALL_PAGE_SIZE / (MIN_SLAB_OBJECT << cls);
+      PageInfo& info = pages[page];
+      info.state = pageState::SLAB;
+      info.sizeClass = cls;
+      info.tag = tag;
+      info.usedObjects = 0;
+      info.freeMask = (numObjects == 64) ? ~0ULL : ((1ULL << numObjects) - 1);
+      //Dirty state of the page is tracked per object while it is a slab
+      info.dirtyMask = (findDirty(page, page + 1, true) == page) ? info.freeMask : 0;
+      setDirty(page, page + 1, false);
+      pushSlab(page);
+      slabPages++;
+   }
+
+   PageInfo& info = pages[page];
+   uint32_t object = __builtin_ctzll(info.freeMask);
+   info.freeMask &= ~(1ULL << object);
+   info.usedObjects++;
+   if (info.freeMask == 0) {
+      removeSlab(page);
+   }
+   unsigned char* ptr = ((unsigned char*) base) + ((uint64_t) page) * SMALL_PAGE_SIZE + object * (MIN_SLAB_OBJECT << cls);
+   if (zero && (info.dirtyMask & (1ULL << object))) {
+      memset(ptr, 0, MIN_SLAB_OBJECT << cls);
+      info.dirtyMask &= ~(1ULL << object);
+   }
+   return ptr;
+}
+
+void MemoryManager::freeObject(uint32_t page, uint64_t offset) {
+   PageInfo& info = pages[page];
+   uint64_t objectSize = MIN_SLAB_OBJECT << info.sizeClass;
+   uint32_t object = offset / objectSize;
+   if ((offset % objectSize) != 0 || (info.freeMask & (1ULL << object))) {
+      std::cerr << "Could not free object at offset " << offset << " of slab page " << page << std::endl;
+      return;
+   }
+   countUsed(info.tag, -((int64_t) objectSize));
+
+   info.dirtyMask |= (1ULL << object);
+   if (info.freeMask == 0) {
+      pushSlab(page);
+   }
+   info.freeMask |= (1ULL << object);
+   info.usedObjects--;
+   if (info.usedObjects == 0) {
+      removeSlab(page);
+      setDirty(page, page + 1, info.dirtyMask != 0);
+      setBlock(page, 1, pageState::USED);
+      freePages(page, info.dirtyMask != 0);
+      slabPages--;
+   }
+}
+
+void MemoryManager::pushSlab(uint32_t page) {
+   uint32_t* head = &partialSlabs[pages[page].tag][pages[page].sizeClass];
+   pages[page].prev = NONE;
+   pages[page].next = *head;
+   if (*head != NONE) {
+      pages[*head].prev = page;
+   }
+   *head = page;
+}
+
+void MemoryManager::removeSlab(uint32_t page) {
+   PageInfo& info = pages[page];
+   if (info.prev != NONE) {
+      pages[info.prev].next = info.next;
+   } else {
+      partialSlabs[info.tag][info.sizeClass] = info.next;
+   }
+   if (info.next != NONE) {
+      pages[info.next].prev = info.prev;
+   }
+}
+
+/*
+ * Statistics
+ */
+void MemoryManager::countUsed(uint8_t tag, int64_t bytes) {
+   bytesInUse += bytes;
+   tagBytesInUse[tag] += bytes;
+   if (bytes > 0) {
+      allocations++;
+      if (bytesInUse > highWaterMark) {
+         highWaterMark = bytesInUse;
+      }
+   }
+}
+
+//Only the highest non-empty bin can hold the largest block
+uint64_t MemoryManager::largestFreeBlock() const {
+   for (uint32_t word = (NUM_BINS + 63) / 64; word-- > 0;) {
+      if (binBitmap[word] != 0) {
+         uint32_t bin = word * 64 + 63 - __builtin_clzll(binBitmap[word]);
+         uint64_t largest = 0;
+         for (uint32_t page = freeLists[bin]; page != NONE; page = pages[page].next) {
+            if (pages[page].blockPages > largest) {
+               largest = pages[page].blockPages;
+            }
+         }
+         return largest * SMALL_PAGE_SIZE;
+      }
+   }
+   return 0;
+}
+
+MemoryManager::MemoryStats MemoryManager::getStats() {
+   std::lock_guard<std::mutex>   lock(this->memoryMutex);
+   MemoryStats stats;
+   memset(&stats, 0, sizeof(stats));
+   stats.regionSize = size;
+   //Cached chunks are untagged and allocated from the manager's view
+   stats.cachedBytes = cachedBytes.load(std::memory_order_relaxed);
+   if (stats.cachedBytes > tagBytesInUse[0]) {
+      stats.cachedBytes = tagBytesInUse[0];
+   }
+   stats.bytesInUse = bytesInUse - stats.cachedBytes;
+   stats.highWaterMark = highWaterMark;
+   stats.slabBytes = slabPages * SMALL_PAGE_SIZE;
+   stats.allocations = allocations;
+   stats.failedAllocations = failedAllocations;
+   for (uint32_t tag = 0; tag < MAX_TAGS; ++tag) {
+      stats.tagBytesInUse[tag] = tagBytesInUse[tag];
+   }
+   stats.tagBytesInUse[0] -= stats.cachedBytes;
+   for (uint32_t bin = 0; bin < NUM_BINS; ++bin) {
+      for (uint32_t page = freeLists[bin]; page != NONE; page = pages[page].next) {
+         uint32_t blockPages = pages[page].blockPages;
+         uint32_t bucket = log2Floor(blockPages);
+         if (bucket >= NUM_HISTOGRAM_BUCKETS) {
+            bucket = NUM_HISTOGRAM_BUCKETS - 1;
+         }
+         stats.freeBlockHistogram[bucket]++;
+         stats.freeBlocks++;
+         stats.freeBytes += ((uint64_t) blockPages) * SMALL_PAGE_SIZE;
+         if (((uint64_t) blockPages) * SMALL_PAGE_SIZE > stats.largestFreeBlock) {
+            stats.largestFreeBlock = ((uint64_t) blockPages) * SMALL_PAGE_SIZE;
+         }
+      }
+   }
+   return stats;
+}
+
+void MemoryManager::printStats() {
+   MemoryStats stats = getStats();
+   std::string names[MAX_TAGS];
+   {
+      std::lock_guard<std::mutex>   lock(this->memoryMutex);
+      for (uint32_t tag = 0; tag < MAX_TAGS; ++tag) {
+         names[tag] = tagNames[tag];
+      }
+   }
+   std::cout << "------------ MEMORY STATISTICS ---------------" << std::endl;
+   std::cout << "region size: " << stats.regionSize << std::endl;
+   std::cout << "bytes in use: " << stats.bytesInUse << std::endl;
+   std::cout << "bytes in thread caches: " << stats.cachedBytes << std::endl;
+   std::cout << "high-water mark: " << stats.highWaterMark << std::endl;
+   std::cout << "free bytes: " << stats.freeBytes << std::endl;
+   std::cout << "slab bytes: " << stats.slabBytes << std::endl;
+   std::cout << "free blocks: " << stats.freeBlocks << std::endl;
+   std::cout << "largest free block: " << stats.largestFreeBlock << std::endl;
+   std::cout << "allocations: " << stats.allocations << std::endl;
+   std::cout << "failed allocations: " << stats.failedAllocations << std::endl;
+   for (uint32_t i = 0; i < NUM_HISTOGRAM_BUCKETS; ++i) {
+      if (stats.freeBlockHistogram[i] > 0) {
+         std::cout << "free blocks of " << (SMALL_PAGE_SIZE << i) << "+ bytes: " << stats.freeBlockHistogram[i] << std::endl;
+      }
+   }
+   for (uint32_t tag = 0; tag < MAX_TAGS; ++tag) {
+      if (stats.tagBytesInUse[tag] > 0 || !names[tag].empty()) {
+         std::cout << "tag " << tag;
+         if (!names[tag].empty()) {
+            std::cout << " (" << names[tag] << ")";
+         }
+         std::cout << ": " << stats.tagBytesInUse[tag] << std::endl;
+      }
+   }
+   std::cout << "----------------------------------" << std::endl;
+}
+
+void MemoryManager::setTagName(uint8_t tag, const std::string& name) {
+   std::lock_guard<std::mutex>   lock(this->memoryMutex);
+   if (tag < MAX_TAGS) {
+      tagNames[tag] = name;
+   }
+}
+
+/*
+ * Dirty page tracking
+ */
+uint32_t MemoryManager::findDirty(uint32_t page, uint32_t end, bool dirty) const {
+   while (page < end) {
+      uint64_t word = dirty ? dirtyBitmap[page / 64] : ~dirtyBitmap[page / 64];
+      word &= ~0ULL << (page % 64);
+      if (word != 0) {
+         uint32_t found = (page & ~63U) + __builtin_ctzll(word);
+         return (found < end) ? found : end;
+      }
+      page = (page & ~63U) + 64;
+   }
+   return end;
+}
+
+void MemoryManager::setDirty(uint32_t page, uint32_t end, bool dirty) {
+   //Keep the part of the known clean range in front of the new dirty pages
+   if (dirty && page < cleanTo && end > cleanFrom) {
+      cleanTo = (page > cleanFrom) ? page : cleanFrom;
+   }
+   while (page < end) {
+      uint32_t bits = 64 - (page % 64);
+      if (bits > end - page) {
+         bits = end - page;
+      }
+      uint64_t mask = ((bits == 64) ? ~0ULL : ((1ULL << bits) - 1)) << (page % 64);
+      if (dirty) {
+         dirtyBitmap[page / 64] |= mask;
+      } else {
+         dirtyBitmap[page / 64] &= ~mask;
+      }
+      page += bits;
+   }
+}
+
+/*
+ * Zeroes up to maxPages dirty pages in [page, end), returns the number of
+ * pages zeroed.
+ */
+uint32_t MemoryManager::zeroDirty(uint32_t page, uint32_t end, uint32_t maxPages) {
+   uint32_t zeroed = 0;
+   page = findDirty(page, end, true);
+   while (page < end && zeroed < maxPages) {
+      uint32_t runEnd = findDirty(page, end, false);
+      if (runEnd - page > maxPages - zeroed) {
+         runEnd = page + (maxPages - zeroed);
+      }
+      memset(((unsigned char*) base) + ((uint64_t) page) * SMALL_PAGE_SIZE, 0, ((uint64_t) (runEnd - page)) * SMALL_PAGE_SIZE);
+      setDirty(page, runEnd, false);
+      zeroed += runEnd - page;
+      page = findDirty(runEnd, end, true);
+   }
+   return zeroed;
+}
+
+/*
+ * Marks the dirty pages in [page, end) clean and hands them to the caller
+ * to zero without the lock
+ */
+void MemoryManager::takeDirty(uint32_t page, uint32_t end, PageRuns& runs) {
+   page = findDirty(page, end, true);
+   while (page < end) {
+      uint32_t runEnd = findDirty(page, end, false);
+      setDirty(page, runEnd, false);
+      runs.emplace_back(page, runEnd);
+      page = findDirty(runEnd, end, true);
+   }
+}
+
+void MemoryManager::zeroRuns(const PageRuns& runs) {
+   for (const std::pair<uint32_t, uint32_t>& run : runs) {
+      memset(((unsigned char*) base) + ((uint64_t) run.first) * SMALL_PAGE_SIZE, 0, ((uint64_t) (run.second - run.first)) * SMALL_PAGE_SIZE);
+   }
+}
+
+/*
+ * Background zeroing
+ */
+void MemoryManager::startZeroing() {
+   std::lock_guard<std::mutex>   lock(this->memoryMutex);
+   if (zeroingEnabled) {
+      return;
+   }
+   zeroingEnabled = true;
+   zeroingThread = std::thread(&MemoryManager::zeroingLoop, this);
+}
+
+void MemoryManager::stopZeroing() {
+   {
+      std::lock_guard<std::mutex>   lock(this->memoryMutex);
+      zeroingEnabled = false;
+      zeroingCondition.notify_one();
+   }
+   if (zeroingThread.joinable()) {
+      zeroingThread.join();
+   }
+}
+
+/*
+ * Caller holds memoryMutex, zeroes one batch of dirty pages in free blocks.
+ * Works on the first block of the dirty free list and resumes behind the
+ * pages it already found clean, so a batch does not rescan the block from
+ * its start. Blocks without dirty pages leave the list.
+ */
+bool MemoryManager::zeroFreeBatch() {
+   while (dirtyFreeBlocks != NONE) {
+      uint32_t block = dirtyFreeBlocks;
+      uint32_t end = block + pages[block].blockPages;
+      uint32_t page = block;
+      if (cleanFrom <= block && block < cleanTo) {
+         page = (cleanTo < end) ? cleanTo : end;
+      }
+      page = findDirty(page, end, true);
+      if (page == end) {
+         removeFreeBlock(block);
+         insertFreeBlock(block, end - block, false);
+         cleanFrom = block;
+         cleanTo = end;
+         continue;
+      }
+      uint32_t runEnd = findDirty(page, end, false);
+      if (runEnd - page > ZEROING_BATCH_PAGES) {
+         runEnd = page + ZEROING_BATCH_PAGES;
+      }
+      memset(((unsigned char*) base) + ((uint64_t) page) * SMALL_PAGE_SIZE, 0, ((uint64_t) (runEnd - page)) * SMALL_PAGE_SIZE);
+      setDirty(page, runEnd, false);
+      cleanFrom = block;
+      cleanTo = runEnd;
+      return true;
+   }
+   return false;
+}
+
+/*
+ * Zeroes free pages in small batches under the lock, so that allocators wait
+ * for at most one batch.
+ */
+void MemoryManager::zeroingLoop() {
+   std::unique_lock<std::mutex> lock(this->memoryMutex);
+   while (zeroingEnabled) {
+      if (zeroFreeBatch()) {
+         lock.unlock();
+         std::this_thread::yield();
+         lock.lock();
+      } else {
+         zeroingCondition.wait(lock);
+      }
+   }
 }
 
 } /* namespace fpga */
@@ -28,37 +28,189 @@
 #define MEM_MANAGER_H
 
 #include <cstddef>
-#include <iostream>
+#include <cstdint>
 #include <atomic>
+#include <iostream>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace fpga {
 
-class MemChunk {
-public:
-   unsigned char*    addr;
-   size_t            size;
-   std::atomic<bool> free;
-   MemChunk*  next;
-   MemChunk(unsigned char* addr, size_t size)
-      :addr(addr), size(size), free(true), next(nullptr) {}
-};
-
+/*
+ * Allocator for the pinned DMA region.
+ *
+ * Requests up to MAX_SLAB_OBJECT bytes are served from 4 KiB slab pages
+ * holding power-of-two objects of a single size class. Larger requests are
+ * rounded to 4 KiB pages and served from a two-level segregated-fit heap:
+ * free blocks are binned by page count, a bitmap over the bins finds the
+ * first fitting bin in constant time and neighbouring free blocks are
+ * merged on free. All bookkeeping lives in a per-page table outside of the
+ * DMA region.
+ *
+ * Memory is not cleared on free. Freed pages and slab objects are only marked
+ * dirty and are zeroed when an allocation asks for zeroed memory, or ahead of
+ * time by the optional background zeroing thread.
+ *
+ * With a huge page boundary set, chunks no larger than a huge page are placed
+ * like in a buddy allocator, at an address aligned to their size rounded up
+ * to a power of two, so that no DMA command on them has to be split by the
+ * TLB. Larger chunks start on a huge page.
+ *
+ * The region can grow up to maxSize. When no free block fits, the grow
+ * handler is asked to make at least the given number of bytes available
+ * directly behind the region and returns how many it added, or 0. It runs
+ * without the lock, one grow at a time, and the new pages are published
+ * once it returns.
+ *
+ * Every chunk carries a tag below MAX_TAGS, 0 if the caller does not set
+ * one, and memory in use is accounted per tag. Slab pages are not shared
+ * between tags.
+ */
 class MemoryManager {
+   friend class ThreadCache;
 
 public:
-   MemoryManager(void*, size_t);
+   typedef std::function<size_t(size_t)> GrowHandler;
+
+   static const uint32_t MAX_TAGS = 8;
+   static const uint32_t NUM_HISTOGRAM_BUCKETS = 24;
+
+   struct MemoryStats {
+      uint64_t regionSize;
+      uint64_t bytesInUse;          // rounded to size class or page
+      uint64_t cachedBytes;         // held in thread caches, not in bytesInUse
+      uint64_t highWaterMark;
+      uint64_t freeBytes;           // in free blocks, without free slab objects
+      uint64_t slabBytes;
+      uint64_t freeBlocks;
+      uint64_t largestFreeBlock;
+      uint64_t freeBlockHistogram[NUM_HISTOGRAM_BUCKETS]; // blocks of [2^i, 2^(i+1)) pages
+      uint64_t allocations;
+      uint64_t failedAllocations;
+      uint64_t tagBytesInUse[MAX_TAGS];
+   };
+
+   MemoryManager(void*, size_t, bool isZeroed=false, size_t maxSize=0);
    ~MemoryManager();
-   void* allocate(size_t size);
+   void* allocate(size_t size, bool zero=true, size_t alignment=0, uint8_t tag=0);
    void free(void*);
+   size_t allocateBatch(size_t size, void** chunks, size_t count, bool zero=true);
+   void freeBatch(void** chunks, size_t count);
+   size_t usableSize(void*) const;
+   uint8_t chunkTag(void*) const;
+
+   MemoryStats getStats();
+   void printStats();
+   void setTagName(uint8_t tag, const std::string& name);
+
+   void setHugePageBoundary(uint64_t boundary);
+   void setGrowHandler(GrowHandler handler, bool isZeroed=false);
+   bool grow(size_t additionalSize, bool isZeroed=false);
+
+   void startZeroing();
+   void stopZeroing();
 
+   static const uint64_t SMALL_PAGE_SIZE = 4096;
+   static const uint64_t MIN_SLAB_OBJECT = 64;
+   static const uint64_t MAX_SLAB_OBJECT = 2048;
+   static const uint32_t ZEROING_BATCH_PAGES = 16;
 
 protected:
+   enum class pageState : uint8_t { INTERIOR=0, FREE=1, USED=2, SLAB=3 };
+
+   struct PageInfo {
+      uint32_t    blockPages;   // valid on the first and last page of a block
+      uint32_t    prev;         // free list / partial slab list links
+      uint32_t    next;
+      pageState   state;
+      bool        isHead;
+      uint8_t     sizeClass;    // slab pages only
+      uint16_t    usedObjects;  // slab pages only
+      uint8_t     tag;          // first page of a used block and slab pages
+      uint64_t    freeMask;     // slab pages only, one bit per free object
+      uint64_t    dirtyMask;    // slab pages only, one bit per dirty object
+      uint32_t    dirtyPrev;    // list of free blocks that may hold dirty pages,
+      uint32_t    dirtyNext;    // valid on the first page of a free block
+      bool        onDirtyList;
+   };
+
+   static const uint32_t NONE = 0xFFFFFFFF;
+   static const uint32_t SL_LOG2 = 3;
+   static const uint32_t SL_COUNT = (1 << SL_LOG2);
+   static const uint32_t NUM_BINS = (32 - SL_LOG2 + 1) * SL_COUNT;
+   static const uint32_t NUM_SIZE_CLASSES = 6;
+
+   //Page ranges [first, second) that still have to be zeroed
+   typedef std::vector<std::pair<uint32_t, uint32_t>> PageRuns;
+
+   static uint32_t binIndex(uint32_t numPages);
+   static uint32_t sizeClass(size_t size);
+
+   void* allocateLocked(size_t size, bool zero, size_t alignment, uint8_t tag, PageRuns* deferredZeroing=nullptr, size_t* growth=nullptr);
+   void freeLocked(void* ptr);
+   uint32_t allocatePages(uint32_t numPages, uint32_t alignPages);
+   uint32_t takeFreePages(uint32_t numPages, uint32_t alignPages);
+   bool growLocked(size_t additionalSize, bool isZeroed);
+   bool growUnlocked(std::unique_lock<std::mutex>& lock, size_t required);
+   uint32_t findFreeBlock(uint32_t bin);
+   uint32_t alignmentGap(uint32_t page, uint32_t alignPages) const;
+   void freePages(uint32_t page, bool isDirty=true);
+   void setBlock(uint32_t page, uint32_t numPages, pageState state);
+   void insertFreeBlock(uint32_t page, uint32_t numPages, bool isDirty);
+   bool removeFreeBlock(uint32_t page);
+
+   void* allocateObject(uint32_t sizeClass, bool zero, uint8_t tag);
+   void freeObject(uint32_t page, uint64_t offset);
+   void pushSlab(uint32_t page);
+   void removeSlab(uint32_t page);
+
+   uint32_t findDirty(uint32_t page, uint32_t end, bool dirty) const;
+   void setDirty(uint32_t page, uint32_t end, bool dirty);
+   uint32_t zeroDirty(uint32_t page, uint32_t end, uint32_t maxPages);
+   void takeDirty(uint32_t page, uint32_t end, PageRuns& runs);
+   void zeroRuns(const PageRuns& runs);
+   bool zeroFreeBatch();
+   void countUsed(uint8_t tag, int64_t bytes);
+   uint64_t largestFreeBlock() const;
+   void zeroingLoop();
 
    void*             base;
    unsigned long     size;
-   MemChunk*  chunks;
-   std::mutex  memoryMutex;
+   uint32_t          numPages;
+   uint32_t          maxPages;
+   PageInfo*         pages;
+   uint32_t          freeLists[NUM_BINS];
+   uint64_t          binBitmap[(NUM_BINS + 63) / 64];
+   uint32_t          partialSlabs[MAX_TAGS][NUM_SIZE_CLASSES];
+   uint64_t*         dirtyBitmap;
+   uint32_t          dirtyFreeBlocks;
+   uint32_t          cleanFrom;     // pages in [cleanFrom, cleanTo) are known to be clean,
+   uint32_t          cleanTo;       // background zeroing resumes behind them
+   uint64_t          hugePageBoundary;
+   GrowHandler       growHandler;
+   bool              growZeroed;
+   bool              growing;
+   std::condition_variable growCondition;
+   size_t            growthRequest;
+   std::mutex        memoryMutex;
+
+   uint64_t          bytesInUse;
+   uint64_t          highWaterMark;
+   uint64_t          slabPages;
+   uint64_t          allocations;
+   uint64_t          failedAllocations;
+   uint64_t          tagBytesInUse[MAX_TAGS];
+   std::string       tagNames[MAX_TAGS];
+   std::atomic<uint64_t> cachedBytes;   // updated by ThreadCache without the lock
+
+   std::thread             zeroingThread;
+   std::condition_variable zeroingCondition;
+   bool                    zeroingEnabled;
 
 };
    
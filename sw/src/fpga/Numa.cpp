@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Numa.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace fpga {
+
+/*
+ * Node of the first device bound to the xdma driver, ANY_NODE if unknown
+ */
+int Numa::deviceNode() {
+   const std::string driverPath = "/sys/bus/pci/drivers/xdma_driver/";
+   DIR* dir = opendir(driverPath.c_str());
+   if (dir == nullptr) {
+      return ANY_NODE;
+   }
+   int node = ANY_NODE;
+   struct dirent* entry;
+   while ((entry = readdir(dir)) != nullptr) {
+      //devices are linked by their PCI address, e.g. 0000:03:00.0
+      std::string name(entry->d_name);
+      if (name.find(':') == std::string::npos) {
+         continue;
+      }
+      std::ifstream file(driverPath + name + "/numa_node");
+      if (file >> node) {
+         break;
+      }
+   }
+   closedir(dir);
+   return (node < 0) ? ANY_NODE : node;
+}
+
+int Numa::resolveNode(int node) {
+   if (node == DEVICE_NODE) {
+      return deviceNode();
+   }
+   return node;
+}
+
+bool Numa::bindMemory(void* addr, uint64_t size, int node) {
+   node = resolveNode(node);
+   if (node < 0) {
+      return false;
+   }
+   std::vector<unsigned long> mask(node / (8 * sizeof(unsigned long)) + 1, 0);
+   mask[node / (8 * sizeof(unsigned long))] |= (1UL << (node % (8 * sizeof(unsigned long))));
+   if (syscall(SYS_mbind, addr, size, MPOL_BIND, mask.data(), mask.size() * 8 * sizeof(unsigned long) + 1, 0) != 0) {
+      std::cerr << "[ERROR] on mbind of " << addr << " to node " << node << std::endl;
+      return false;
+   }
+   return true;
+}
+
+/*
+ * Restricts the calling thread to the cpus of node
+ */
+bool Numa::pinThread(int node) {
+   node = resolveNode(node);
+   if (node < 0) {
+      return false;
+   }
+   std::vector<int> cpus = nodeCpus(node);
+   if (cpus.empty()) {
+      std::cerr << "[ERROR] no cpus found for node " << node << std::endl;
+      return false;
+   }
+   cpu_set_t cpuSet;
+   CPU_ZERO(&cpuSet);
+   for (int cpu : cpus) {
+      CPU_SET(cpu, &cpuSet);
+   }
+   if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet) != 0) {
+      std::cerr << "[ERROR] on pinning thread to node " << node << std::endl;
+      return false;
+   }
+   return true;
+}
+
+//Parses the cpulist of node, e.g. 0-7,16-23
+std::vector<int> Numa::nodeCpus(int node) {
+   std::vector<int> cpus;
+   std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+   std::string list;
+   if (!(file >> list)) {
+      return cpus;
+   }
+   std::stringstream ranges(list);
+   std::string range;
+   while (std::getline(ranges, range, ',')) {
+      size_t dash = range.find('-');
+      int first = std::stoi(range.substr(0, dash));
+      int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+      for (int cpu = first; cpu <= last; ++cpu) {
+         cpus.push_back(cpu);
+      }
+   }
+   return cpus;
+}
+
+} /* namespace fpga */
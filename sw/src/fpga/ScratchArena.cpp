@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "ScratchArena.h"
+
+#include <string.h>
+
+#include <iostream>
+
+#include <fpga/Fpga.h>
+
+namespace fpga {
+
+ScratchArena::ScratchArena(uint64_t capacity, uint8_t tag)
+   : base(nullptr), length(0), used(0), owned(true) {
+   base = (char*) Fpga::allocate(capacity, true, CACHE_LINE_SIZE, tag);
+   if (base != nullptr) {
+      length = capacity;
+   }
+   marked.reserve(1024);
+}
+
+/*
+ * Arena on memory owned by the caller, e.g. the result part of a window.
+ * The memory has to be zeroed already.
+ */
+ScratchArena::ScratchArena(void* base, uint64_t capacity)
+   : base((char*) base), length(capacity), used(0), owned(false) {
+   marked.reserve(1024);
+}
+
+ScratchArena::~ScratchArena() {
+   if (owned && base != nullptr) {
+      Fpga::free(base);
+   }
+}
+
+void* ScratchArena::allocateFailed(uint64_t size) {
+   std::cerr << "[ERROR] scratch arena full, requested: " << size << ", used: " << used << ", capacity: " << length << std::endl;
+   return nullptr;
+}
+
+void ScratchArena::reset(ResetMode mode) {
+   if (mode == CLEAR_USED) {
+      memset(base, 0, used);
+   } else if (mode == CLEAR_MARKED) {
+      for (auto& range : marked) {
+         //Poll words are cleared with a single store
+         if (range.second == sizeof(uint64_t) && (range.first % sizeof(uint64_t)) == 0) {
+            *((volatile uint64_t*) (base + range.first)) = 0;
+         } else {
+            memset(base + range.first, 0, range.second);
+         }
+      }
+   }
+   marked.clear();
+   used = 0;
+}
+
+} /* namespace fpga */
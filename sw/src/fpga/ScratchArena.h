@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <cstdint>
+#include <vector>
+
+namespace fpga {
+
+/*
+ * Bump pointer arena for result areas that are filled by the FPGA and
+ * reused for every request. Sub-buffers are carved out with allocate and
+ * all of them are dropped at once with reset.
+ *
+ * The memory is zeroed once. Afterwards reset only clears what the caller
+ * asks for: nothing, the used part, or the ranges marked with mark,
+ * typically the words that are polled for completion.
+ */
+class ScratchArena {
+
+public:
+   enum ResetMode {
+      KEEP,          //drop allocations, clear nothing
+      CLEAR_MARKED,  //clear the ranges passed to mark
+      CLEAR_USED     //clear everything allocated since the last reset
+   };
+
+   explicit ScratchArena(uint64_t capacity, uint8_t tag=0);
+   ScratchArena(void* base, uint64_t capacity);
+   ~ScratchArena();
+
+   ScratchArena(ScratchArena const&)      = delete;
+   void operator =(ScratchArena const&)   = delete;
+
+   void* allocate(uint64_t size, uint64_t alignment=CACHE_LINE_SIZE) {
+      uint64_t offset = (used + alignment - 1) & ~(alignment - 1);
+      if (offset + size > length) {
+         return allocateFailed(size);
+      }
+      used = offset + size;
+      return base + offset;
+   }
+   template <class T>
+   T* allocate(uint64_t count=1) {
+      return (T*) allocate(count * sizeof(T), alignof(T) > CACHE_LINE_SIZE ? alignof(T) : CACHE_LINE_SIZE);
+   }
+
+   void mark(const volatile void* ptr, uint64_t size=sizeof(uint64_t)) {
+      marked.emplace_back((uint64_t) ((const char*) ptr - base), size);
+   }
+   void reset(ResetMode mode=CLEAR_MARKED);
+
+   void* data() const { return base; }
+   uint64_t capacity() const { return length; }
+   uint64_t size() const { return used; }
+
+   static const uint64_t CACHE_LINE_SIZE = 64;
+
+private:
+   void* allocateFailed(uint64_t size);
+
+   char*    base;
+   uint64_t length;
+   uint64_t used;
+   bool     owned;
+   std::vector<std::pair<uint64_t, uint64_t>> marked;
+
+};
+
+} /* namespace fpga */
+
+#endif
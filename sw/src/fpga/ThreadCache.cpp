@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ThreadCache.h"
+#include "MemoryManager.h"
+
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace fpga {
+
+/*
+ * Released MemoryManagers with the value of releases after their release.
+ * Caches never touch each other, a cache bound to a released manager notices
+ * it the next time it binds or clears and drops its chunks instead of
+ * returning them.
+ */
+static std::mutex releaseMutex;
+static std::vector<std::pair<MemoryManager*, uint64_t>>* released = nullptr;
+static std::atomic<uint64_t> releases(0);
+
+//Bumped by every reclaim, caches that see a new value flush themselves
+static std::atomic<uint64_t> reclaims(0);
+
+ThreadCache::ThreadCache()
+   :owner(nullptr), ownerReleases(0), seenReclaims(0)
+{
+   memset(magazines, 0, sizeof(magazines));
+}
+
+ThreadCache::~ThreadCache()
+{
+   std::lock_guard<std::mutex> guard(releaseMutex);
+   clear();
+}
+
+ThreadCache& ThreadCache::local()
+{
+   static thread_local ThreadCache cache;
+   return cache;
+}
+
+void* ThreadCache::allocate(MemoryManager* mm, size_t size, bool zero)
+{
+   uint32_t index = classIndex(size);
+   if (index == NOT_CACHED) {
+      void* ptr = mm->allocate(size, zero);
+      if (ptr == nullptr && reclaim(mm)) {
+         ptr = mm->allocate(size, zero);
+      }
+      return ptr;
+   }
+
+   ThreadCache& cache = local();
+   cache.bind(mm);
+   Magazine& magazine = cache.magazines[index];
+   if (magazine.count == 0) {
+      magazine.count = mm->allocateBatch(classSize(index), magazine.chunks, MAGAZINE_SIZE / 2, false);
+      if (magazine.count == 0 && reclaim(mm)) {
+         magazine.count = mm->allocateBatch(classSize(index), magazine.chunks, MAGAZINE_SIZE / 2, false);
+      }
+      if (magazine.count == 0) {
+         return nullptr;
+      }
+      mm->cachedBytes.fetch_add(magazine.count * classSize(index), std::memory_order_relaxed);
+   }
+   //Cached chunks are dirty
+   void* ptr = magazine.chunks[--magazine.count];
+   mm->cachedBytes.fetch_sub(classSize(index), std::memory_order_relaxed);
+   if (zero) {
+      memset(ptr, 0, size);
+   }
+   return ptr;
+}
+
+void ThreadCache::free(MemoryManager* mm, void* ptr)
+{
+   //Tagged chunks go back to the MemoryManager to keep its accounting exact
+   uint32_t index = classIndex(mm->usableSize(ptr));
+   if (index == NOT_CACHED || mm->chunkTag(ptr) != 0) {
+      mm->free(ptr);
+      return;
+   }
+
+   ThreadCache& cache = local();
+   cache.bind(mm);
+   Magazine& magazine = cache.magazines[index];
+   if (magazine.count == MAGAZINE_SIZE) {
+      cache.drain(index, MAGAZINE_SIZE / 2);
+   }
+   magazine.chunks[magazine.count++] = ptr;
+   mm->cachedBytes.fetch_add(classSize(index), std::memory_order_relaxed);
+}
+
+void ThreadCache::flush()
+{
+   ThreadCache& cache = local();
+   std::lock_guard<std::mutex> guard(releaseMutex);
+   cache.clear();
+}
+
+/*
+ * Returns false if no cache holds chunks of mm, retrying would not help.
+ * Other threads flush asynchronously, their chunks are only available to
+ * later allocations.
+ */
+bool ThreadCache::reclaim(MemoryManager* mm)
+{
+   if (mm->cachedBytes.load(std::memory_order_relaxed) == 0) {
+      return false;
+   }
+   reclaims.fetch_add(1, std::memory_order_relaxed);
+   ThreadCache& cache = local();
+   cache.bind(mm);
+   return true;
+}
+
+void ThreadCache::release(MemoryManager* mm)
+{
+   std::lock_guard<std::mutex> guard(releaseMutex);
+   if (released == nullptr) {
+      released = new std::vector<std::pair<MemoryManager*, uint64_t>>();
+   }
+   released->push_back(std::make_pair(mm, ++releases));
+}
+
+uint32_t ThreadCache::classIndex(size_t size)
+{
+   if (size == 0) {
+      return NOT_CACHED;
+   }
+   if (size <= MemoryManager::MAX_SLAB_OBJECT) {
+      uint32_t index = 0;
+      while ((MemoryManager::MIN_SLAB_OBJECT << index) < size) {
+         index++;
+      }
+      return index;
+   }
+   size_t pages = (size + MemoryManager::SMALL_PAGE_SIZE - 1) / MemoryManager::SMALL_PAGE_SIZE;
+   if (pages > MAX_CACHED_PAGES) {
+      return NOT_CACHED;
+   }
+   return NUM_SLAB_CLASSES + pages - 1;
+}
+
+size_t ThreadCache::classSize(uint32_t index)
+{
+   if (index < NUM_SLAB_CLASSES) {
+      return MemoryManager::MIN_SLAB_OBJECT << index;
+   }
+   return (index - NUM_SLAB_CLASSES + 1) * MemoryManager::SMALL_PAGE_SIZE;
+}
+
+void ThreadCache::bind(MemoryManager* mm)
+{
+   //A manager released since binding may have been replaced at the same address
+   if (owner != mm || ownerReleases != releases.load(std::memory_order_relaxed)
+         || seenReclaims != reclaims.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> guard(releaseMutex);
+      clear();
+      owner = mm;
+      ownerReleases = releases.load(std::memory_order_relaxed);
+      seenReclaims = reclaims.load(std::memory_order_relaxed);
+   }
+}
+
+void ThreadCache::drain(uint32_t index, uint32_t count)
+{
+   Magazine& magazine = magazines[index];
+   magazine.count -= count;
+   owner->cachedBytes.fetch_sub(count * classSize(index), std::memory_order_relaxed);
+   owner->freeBatch(&magazine.chunks[magazine.count], count);
+}
+
+//Caller holds releaseMutex
+void ThreadCache::clear()
+{
+   if (owner == nullptr) {
+      return;
+   }
+   bool ownerReleased = false;
+   if (released != nullptr) {
+      for (auto& release : *released) {
+         ownerReleased |= (release.first == owner && release.second > ownerReleases);
+      }
+   }
+   if (ownerReleased) {
+      memset(magazines, 0, sizeof(magazines));
+      owner = nullptr;
+      return;
+   }
+   for (uint32_t i = 0; i < NUM_CLASSES; ++i) {
+      if (magazines[i].count > 0) {
+         drain(i, magazines[i].count);
+      }
+   }
+}
+
+} /* namespace fpga */
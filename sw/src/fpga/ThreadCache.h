@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef THREAD_CACHE_H
+#define THREAD_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fpga {
+
+class MemoryManager;
+
+/*
+ * Per-thread magazines of recently freed DMA chunks, one per size class.
+ * Sub-page objects and chunks of up to MAX_CACHED_PAGES pages are served
+ * without touching the MemoryManager lock. Empty magazines are refilled and
+ * full magazines are drained in batches of MAGAZINE_SIZE/2 chunks.
+ *
+ * When the manager runs out of memory, reclaim flushes the calling thread's
+ * cache and asks every other cache to flush the next time its thread
+ * allocates or frees, the failed allocation is retried once.
+ */
+class ThreadCache {
+
+public:
+   static void* allocate(MemoryManager* mm, size_t size, bool zero=true);
+   static void free(MemoryManager* mm, void* ptr);
+   static void flush();
+   static bool reclaim(MemoryManager* mm);
+   static void release(MemoryManager* mm);
+
+   static const uint32_t MAGAZINE_SIZE = 32;
+   static const uint32_t MAX_CACHED_PAGES = 16;
+
+   ThreadCache(ThreadCache const&)   = delete;
+   void operator =(ThreadCache const&) = delete;
+
+private:
+   ThreadCache();
+   ~ThreadCache();
+
+   static ThreadCache& local();
+   static uint32_t classIndex(size_t size);
+   static size_t classSize(uint32_t index);
+   void bind(MemoryManager* mm);
+   void drain(uint32_t index, uint32_t count);
+   void clear();
+
+   static const uint32_t NUM_SLAB_CLASSES = 6;
+   static const uint32_t NUM_CLASSES = NUM_SLAB_CLASSES + MAX_CACHED_PAGES;
+   static const uint32_t NOT_CACHED = 0xFFFFFFFF;
+
+   struct Magazine {
+      uint32_t count;
+      void*    chunks[MAGAZINE_SIZE];
+   };
+
+   MemoryManager* owner;
+   uint64_t       ownerReleases;
+   uint64_t       seenReclaims;
+   Magazine       magazines[NUM_CLASSES];
+};
+
+} /* namespace fpga */
+
+#endif
@@ -17,6 +17,7 @@
 #include <algorithm>
 
 #include <fpga/Fpga.h>
+#include <fpga/ScratchArena.h>
 #include <communication/Communicator.h>
 #include <communication/HardRoceCommunicator.h>
 
@@ -180,10 +181,8 @@ int main(int argc, char *argv[]) {
       //--pollPtr;
 
       volatile HashTableEntry* keyPtr = (HashTableEntry*) dmaBuffer;
-      volatile HashTableEntry* entryPtr = (HashTableEntry*) (dmaBuffer + (hashTableSize/sizeof(uint64_t)));
-      unsigned char* valuePtr = (unsigned char*) dmaBuffer;
-      valuePtr += (hashTableSize);
-      valuePtr += (numberOfQueries*sizeof(HashTableEntry));
+      //Entries followed by values, only the polled words are cleared between repetitions
+      fpga::ScratchArena results(dmaBuffer + (hashTableSize/sizeof(uint64_t)), resultSize);
       uint64_t entryOffset = 0;
       uint64_t valueOffset = 0;
 
@@ -192,9 +191,7 @@ int main(int argc, char *argv[]) {
 
       //read all hash table entries and values
       for (uint32_t r = 0; r < numberRepetitions+1; ++r) {
-         volatile HashTableEntry* ePtr = entryPtr;
          entryOffset = 0;
-         unsigned char* vPtr = valuePtr;
          if (r == 0) {
             if (!runWarmup)
                   continue;
@@ -202,7 +199,8 @@ int main(int argc, char *argv[]) {
          } else {
             std::cout << "Repetition: " << r <<  "/" << numberRepetitions << std::endl;
          }
-         memset((void*) (dmaBuffer+(hashTableSize/sizeof(uint64_t))), 0, resultSize);
+         results.reset();
+         volatile HashTableEntry* ePtr = results.allocate<HashTableEntry>(numberOfQueries);
          queryIndexes.clear();
          queryIndexes.reserve(numberOfQueries);
 
@@ -216,13 +214,17 @@ int main(int argc, char *argv[]) {
             queryIndexes.push_back(randOffset);
             entryOffset = randOffset * sizeof(HashTableEntry); 
 
+            unsigned char* vPtr = (unsigned char*) results.allocate(valueSize, sizeof(uint64_t));
+            results.mark(&(ePtr->key));
+            results.mark(vPtr + valueSize - sizeof(uint64_t));
+
             auto start = std::chrono::high_resolution_clock::now();
 
             if (!usePtrChase) {
                communicator->get((void*) ePtr, sizeof(HashTableEntry), 0, 0, entryOffset, window);
                //wait for entry
                //std::cout << "polling" << std::endl;
-               while(ePtr->key == 0) {};
+               communicator->waitForGets(&(ePtr->key));
                //std::cout << std::dec << q << ": " << std::hex << ePtr->key << " -> " << ePtr->value_ptr << std::endl;
 
                uint64_t valueOffset = (uint64_t) (((uint64_t) ePtr->value_ptr) - remoteBaseAddr);
@@ -245,7 +247,11 @@ int main(int argc, char *argv[]) {
             volatile uint64_t* valuePollPtr = (uint64_t*)vPtr;
             valuePollPtr--;
 //std::cout << "polling for value, valuPollPtr: "<< std::hex << valuePollPtr << std::endl;
-            while (*valuePollPtr == 0) {};
+            if (usePtrChase) {
+               while (*valuePollPtr == 0) {};
+            } else {
+               communicator->waitForGets(valuePollPtr);
+            }
             auto end = std::chrono::high_resolution_clock::now();
             durationUs = (std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count() / 1000.0);
             if (r != 0) {
@@ -48,7 +48,9 @@ int main(int argc, char *argv[]) {
                                     ("address", boost::program_options::value<std::string>(), "master ip address")
                                     ("warmup,w", boost::program_options::value<bool>(), "run warm up")
                                     ("isWrite", boost::program_options::value<bool>(), "operation")
-                                    ("isLatency", boost::program_options::value<bool>(), "latency");
+                                    ("isLatency", boost::program_options::value<bool>(), "latency")
+                                    ("memoryNode", boost::program_options::value<int>(), "NUMA node of the DMA memory, default: node of the FPGA")
+                                    ("threadNode", boost::program_options::value<int>(), "NUMA node of the polling thread, default: node of the FPGA");
                                     
 
    boost::program_options::variables_map commandLineArgs;
@@ -64,6 +66,8 @@ int main(int argc, char *argv[]) {
    bool runWarmUp = true;
    bool isWrite = true;
    bool isLatency = false;
+   int memoryNode = fpga::Numa::DEVICE_NODE;
+   int threadNode = fpga::Numa::DEVICE_NODE;
 
    if (commandLineArgs.count("size") > 0) {
       transferSize = commandLineArgs["size"].as<uint64_t>();
@@ -88,6 +92,12 @@ int main(int argc, char *argv[]) {
    if (commandLineArgs.count("isLatency") > 0) {
       isLatency = commandLineArgs["isLatency"].as<bool>();
    }
+   if (commandLineArgs.count("memoryNode") > 0) {
+      memoryNode = commandLineArgs["memoryNode"].as<int>();
+   }
+   if (commandLineArgs.count("threadNode") > 0) {
+      threadNode = commandLineArgs["threadNode"].as<int>();
+   }
 
    std::cout << "tranferSize " << transferSize << std::endl;
    if (isWrite) {
@@ -103,7 +113,13 @@ int main(int argc, char *argv[]) {
    }
 
    fpga::Fpga::setNodeId(nodeId);
+   fpga::Fpga::setNumaNode(memoryNode);
    fpga::Fpga::initializeMemory();
+   if (!fpga::Fpga::pinThread(threadNode)) {
+      std::cout << "polling thread not pinned" << std::endl;
+   }
+   std::cout << "FPGA node: " << fpga::Numa::deviceNode() << ", memory node: " << fpga::Fpga::getNumaNode()
+             << ", thread node: " << fpga::Numa::resolveNode(threadNode) << std::endl;
 
    communication::HardRoceCommunicator* communicator = new communication::HardRoceCommunicator(fpga::Fpga::getController(), nodeId, numberOfNodes, 1, masterAddr);
 
@@ -151,8 +167,12 @@ int main(int argc, char *argv[]) {
          } else {
             communicator->get(dmaBuffer, transferSize, transferSize, 0, 0, window);
          }
-         
-         while(*pollPtr == 0);
+
+         if (isWrite) {
+            communicator->waitForRemoteWrites(1, pollPtr);
+         } else {
+            communicator->waitForGets(pollPtr);
+         }
          auto end = std::chrono::high_resolution_clock::now();
          durationUs = (std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count() / 1000.0);
 
@@ -178,7 +198,7 @@ int main(int argc, char *argv[]) {
                continue;
             }
             //busy polling
-            while (*pollPtr == 0);
+            communicator->waitForRemoteWrites(1, pollPtr);
             //send back
             communicator->put(dmaBuffer, transferSize, 0, 1, transferSize, window);
 
@@ -186,7 +206,8 @@ int main(int argc, char *argv[]) {
             memset((void*) pollPtr, 0, 64);
          }
       } else {
-         while (*pollPtr == 0);
+         //data to read and release
+         communicator->waitForRemoteWrites(2, pollPtr);
       }
    }
 
@@ -259,7 +280,8 @@ int main(int argc, char *argv[]) {
       std::cout << std::fixed << "Message rate [Msg/s]: " << (messageRate * 1000.0 * 1000.0) << std::endl;
       std::cout << "Stddev: " <<stddev << std::endl;
 
-      std::cout << "#" << transferSize << "\t" << messageRate  << "\t" << stddev << std::endl;
+      std::cout << "#" << transferSize << "\t" << messageRate  << "\t" << stddev << "\t" << fpga::Fpga::getNumaNode()
+                << "\t" << fpga::Numa::resolveNode(threadNode) << std::endl;
    }
 
    fpga::Fpga::getController()->printDebugRegs();
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+#include <boost/program_options.hpp>
+
+#include <fpga/Fpga.h>
+#include <communication/HardRoceCommunicator.h>
+#include <communication/FileLoader.h>
+
+/*
+ * Measures loading a file into DMA memory and putting it to the other node,
+ * first one after the other and then pipelined with FileLoader::loadAndPut.
+ * Both nodes need the file to size their window, only the sender reads it.
+ */
+
+using namespace std::chrono_literals;
+
+double elapsedUs(std::chrono::high_resolution_clock::time_point start) {
+   auto end = std::chrono::high_resolution_clock::now();
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count() / 1000.0;
+}
+
+int main(int argc, char *argv[]) {
+
+   //command line arguments
+
+   boost::program_options::options_description programDescription("Allowed options");
+   programDescription.add_options()("file,f", boost::program_options::value<std::string>(), "File to load")
+                                    ("chunkSize,c", boost::program_options::value<uint64_t>(), "Bytes per read and put, default: 4MiB")
+                                    ("readers,r", boost::program_options::value<uint32_t>(), "Number of reader threads, default: 4")
+                                    ("address", boost::program_options::value<std::string>(), "master ip address");
+
+   boost::program_options::variables_map commandLineArgs;
+   boost::program_options::store(boost::program_options::parse_command_line(argc, argv, programDescription), commandLineArgs);
+   boost::program_options::notify(commandLineArgs);
+
+   int32_t numberOfNodes = 2;
+   int32_t nodeId = 0;
+   std::string path;
+   uint64_t chunkSize = communication::FileLoader::CHUNK_SIZE;
+   uint32_t numberOfReaders = communication::FileLoader::NUM_READERS;
+   const char* masterAddr = nullptr;
+
+   if (commandLineArgs.count("file") > 0) {
+      path = commandLineArgs["file"].as<std::string>();
+   } else {
+      std::cerr << "argument missing";
+      return 1;
+   }
+   if (commandLineArgs.count("chunkSize") > 0) {
+      chunkSize = commandLineArgs["chunkSize"].as<uint64_t>();
+   }
+   if (commandLineArgs.count("readers") > 0) {
+      numberOfReaders = commandLineArgs["readers"].as<uint32_t>();
+   }
+   if (commandLineArgs.count("address") > 0) {
+      nodeId = 1;
+      masterAddr = commandLineArgs["address"].as<std::string>().c_str();
+      std::cout << "master: " << masterAddr << std::endl;
+   }
+
+   uint64_t fileSize = communication::FileLoader::fileSize(path.c_str());
+   uint64_t bufferSize = communication::FileLoader::bufferSize(fileSize);
+   std::cout << "file size " << fileSize << std::endl;
+
+   fpga::Fpga::setNodeId(nodeId);
+   fpga::Fpga::initializeMemory();
+
+   communication::HardRoceCommunicator* communicator = new communication::HardRoceCommunicator(fpga::Fpga::getController(), nodeId, numberOfNodes, 1, masterAddr);
+
+   //The window holds the file, followed by a flag and the value to set it to
+   uint64_t windowSize = bufferSize + 64;
+   uint64_t* dmaBuffer = (uint64_t*) fpga::Fpga::allocate(windowSize, false, communication::FileLoader::DIRECT_IO_ALIGNMENT);
+   communication::RoceWin* window = (communication::RoceWin*) calloc(1, sizeof(communication::RoceWin));
+   communicator->exchangeWindow(dmaBuffer, windowSize, window);
+   volatile uint64_t* flag = dmaBuffer + (bufferSize / sizeof(uint64_t));
+   flag[0] = 0;
+   flag[1] = 1;
+
+   if (nodeId == 1) { //sender
+      communication::FileLoader loader(communicator, chunkSize, numberOfReaders);
+
+      auto start = std::chrono::high_resolution_clock::now();
+      if (loader.load(path.c_str(), dmaBuffer, bufferSize) != fileSize) {
+         std::cerr << "[ERROR] could not load " << path << std::endl;
+      }
+      double loadUs = elapsedUs(start);
+
+      start = std::chrono::high_resolution_clock::now();
+      communicator->put(dmaBuffer, fileSize, 0, 0, 0, window);
+      communicator->put((void*) &flag[1], sizeof(uint64_t), 0, 0, bufferSize, window);
+      while (*flag == 0);
+      double putUs = elapsedUs(start);
+
+      *flag = 0;
+      std::this_thread::sleep_for(1s);
+
+      start = std::chrono::high_resolution_clock::now();
+      if (loader.loadAndPut(path.c_str(), dmaBuffer, bufferSize, 0, 0, window) != fileSize) {
+         std::cerr << "[ERROR] could not load " << path << std::endl;
+      }
+      communicator->put((void*) &flag[1], sizeof(uint64_t), 0, 0, bufferSize, window);
+      while (*flag == 0);
+      double pipelinedUs = elapsedUs(start);
+
+      std::cout << "Load[us]: " << loadUs << std::endl;
+      std::cout << "Put[us]: " << putUs << std::endl;
+      std::cout << "Load then put[us]: " << (loadUs + putUs) << std::endl;
+      std::cout << "Pipelined[us]: " << pipelinedUs << std::endl;
+      std::cout << std::fixed << "#" << fileSize << "\t" << loadUs << "\t" << putUs << "\t" << pipelinedUs << std::endl;
+   } else { //receiver
+      for (uint32_t r = 0; r < 2; ++r) {
+         //busy polling
+         while (*flag == 0);
+         *flag = 0;
+         //send back
+         communicator->put((void*) &flag[1], sizeof(uint64_t), 0, 1, bufferSize, window);
+      }
+   }
+
+   fpga::Fpga::getController()->printDmaStatsRegs();
+
+   fpga::Fpga::free(dmaBuffer);
+   fpga::Fpga::clear();
+
+   return 0;
+}
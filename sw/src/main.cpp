@@ -35,13 +35,81 @@
 #include <fpga/Fpga.h>
 #include <fpga/FpgaController.h>
 
+#include <chrono>
+#include <algorithm>
+
+static void runPoint(fpga::FpgaController* controller, void* baseAddr, uint64_t memorySize, uint32_t accesses, uint32_t chunkLength, uint32_t strideLength,
+                     double clockPeriod, bool isWrite, bool useDDR, uint8_t ddrChannel) {
+   bool isRandom = (strideLength != 0);
+
+   if (isRandom) {
+      std::cout << "Random ";
+   } else {
+      std::cout << "Sequential ";
+   }
+   if (isWrite) {
+      std::cout << "write ";
+   } else {
+      std::cout << "read ";
+   }
+   std::cout << "memory size: " << memorySize << ", number of accesses: " << accesses << ", length per access: " << chunkLength;
+   if (isRandom) {
+      std::cout << ", stride length: " << strideLength;
+   }
+   std::cout << std::endl;
+
+   uint64_t cycles = 0;
+   if (!useDDR)
+   {
+      if (!isRandom) {
+         if (isWrite) {
+            cycles = controller->runDmaSeqWriteBenchmark((uint64_t) baseAddr, memorySize, accesses, chunkLength);
+         } else {
+            cycles = controller->runDmaSeqReadBenchmark((uint64_t) baseAddr, memorySize, accesses, chunkLength);
+         }
+      } else {
+         if (isWrite) {
+            cycles = controller->runDmaRandomWriteBenchmark((uint64_t) baseAddr, memorySize, accesses, chunkLength, strideLength);
+         } else {
+            cycles = controller->runDmaRandomReadBenchmark((uint64_t) baseAddr, memorySize, accesses, chunkLength, strideLength);
+         }
+      }
+   }
+   else //DDR
+   {
+      if (!isRandom) {
+         if (isWrite) {
+            cycles = controller->runDramSeqWriteBenchmark((uint64_t) baseAddr, memorySize, accesses, chunkLength, ddrChannel);
+         } else {
+            cycles = controller->runDramSeqReadBenchmark((uint64_t) baseAddr, memorySize, accesses, chunkLength, ddrChannel);
+         }
+      } else {
+         if (isWrite) {
+            cycles = controller->runDramRandomWriteBenchmark((uint64_t) baseAddr, memorySize, accesses, chunkLength, strideLength, ddrChannel);
+         } else {
+            cycles = controller->runDramRandomReadBenchmark((uint64_t) baseAddr, memorySize, accesses, chunkLength, strideLength, ddrChannel);
+         }
+      }
+   }
+
+   std::cout << "Execution cycles: " << cycles << std::endl;
+   uint64_t transferSize = ((uint64_t) accesses) * ((uint64_t) chunkLength);
+   double transferSizeGB  = ((double) transferSize) / 1024.0 / 1024.0 / 1024.0;
+   double tp  =  transferSizeGB / ((double) (clockPeriod*cycles) / 1000.0 / 1000.0 / 1000.0);
+   std::cout << std::fixed << "Transfer size [GiB]: " << transferSizeGB << std::endl;
+   std::cout << std::fixed << "Throughput[GiB/s]: " << tp << std::endl;
+   std::cout << std::fixed << "#" << memorySize << "\t" << transferSizeGB << "\t" << chunkLength << "\t" << strideLength << "\t" << cycles << "\t" << tp << std::endl;
+}
+
 
 int main(int argc, char *argv[]) {
 
    boost::program_options::options_description programDescription("Allowed options");
    programDescription.add_options()("memorySize,m", boost::program_options::value<unsigned long>(), "Size of the memory region")
                                     ("accesses,a", boost::program_options::value<unsigned int>(), "Number of memory accesses")
+                                    ("chunkLength,c", boost::program_options::value<unsigned int>(), "Length per memory access")
                                     ("strideLength,s", boost::program_options::value<unsigned int>(), "Stride length between memory accesses")
+                                    ("sweep", boost::program_options::value<unsigned int>(), "Sweep chunk and stride lengths from chunkLength up to this length")
                                     ("isWrite,w", boost::program_options::value<bool>(), "is write")
                                     ("testDDR,t", boost::program_options::value<bool>(), "use DDR")
                                     ("ddrChannel,d", boost::program_options::value<unsigned int>(), "DDR channel, default: 0")
@@ -65,6 +133,8 @@ int main(int argc, char *argv[]) {
    bool isWrite          = true;
    bool useDDR           = false;
    uint8_t ddrChannel    = 0;
+   bool sweep            = false;
+   uint32_t maxChunkLength = 0;
 
    if (commandLineArgs.count("memorySize") > 0) {
       memorySize = commandLineArgs["memorySize"].as<unsigned long>();
@@ -90,69 +160,42 @@ int main(int argc, char *argv[]) {
    if (commandLineArgs.count("ddrChannel") > 0) {
       ddrChannel = commandLineArgs["ddrChannel"].as<unsigned int>();
    }
- 
-   bool isRandom = (strideLength != 0);
-
-   if (isRandom) {
-      std::cout << "Random ";
-   } else {
-      std::cout << "Sequential ";
+   if (commandLineArgs.count("sweep") > 0) {
+      sweep = true;
+      maxChunkLength = commandLineArgs["sweep"].as<unsigned int>();
    }
-   if (isWrite) {
-      std::cout << "write ";
-   } else {
-      std::cout << "read ";
+   maxChunkLength = std::max(maxChunkLength, chunkLength);
+   if (sweep && chunkLength == 0) {
+      std::cerr << "[ERROR] sweep needs a chunk length larger than 0" << std::endl;
+      fpga::Fpga::clear();
+      return 1;
    }
-   std::cout << "memory size: " << memorySize << ", number of accesses: " << accesses << ", length per access: " << chunkLength;
-   if (isRandom) {
-      std::cout << ", stride length: " << strideLength;
+ 
+   if (sweep) {
+      std::cout << "Sweeping chunk lengths " << chunkLength << " to " << maxChunkLength << ", stride lengths 0 and " << chunkLength << " to " << maxChunkLength << std::endl;
    }
-   std::cout << std::endl;
 
    void* baseAddr = fpga::Fpga::allocate(memorySize);
 
-
-   uint64_t cycles = 0;
-   if (!useDDR)
-   {
-      if (!isRandom) {
-         if (isWrite) {
-            cycles = controller->runDmaSeqWriteBenchmark((uint64_t) baseAddr, memorySize, accesses, chunkLength);
-         } else {
-            cycles = controller->runDmaSeqReadBenchmark((uint64_t) baseAddr, memorySize, accesses, chunkLength);
-         }
-      } else {
-         if (isWrite) {
-            cycles = controller->runDmaRandomWriteBenchmark((uint64_t) baseAddr, memorySize, accesses, chunkLength, strideLength);
-         } else {
-            cycles = controller->runDmaRandomReadBenchmark((uint64_t) baseAddr, memorySize, accesses, chunkLength, strideLength);
-         }
+   auto sweepStart = std::chrono::high_resolution_clock::now();
+   uint32_t points = 0;
+   //64-bit lengths, doubling past 2^31 must not wrap
+   for (uint64_t chunk = chunkLength; chunk <= maxChunkLength; chunk *= 2) {
+      //The first point of a sweep is sequential
+      runPoint(controller, baseAddr, memorySize, accesses, chunk, sweep ? 0 : strideLength, clockPeriod, isWrite, useDDR, ddrChannel);
+      points++;
+      if (!sweep) {
+         break;
       }
-   }
-   else //DDR
-   {
-      if (!isRandom) {
-         if (isWrite) {
-            cycles = controller->runDramSeqWriteBenchmark((uint64_t) baseAddr, memorySize, accesses, chunkLength, ddrChannel);
-         } else {
-            cycles = controller->runDramSeqReadBenchmark((uint64_t) baseAddr, memorySize, accesses, chunkLength, ddrChannel);
-         }
-      } else {
-         if (isWrite) {
-            cycles = controller->runDramRandomWriteBenchmark((uint64_t) baseAddr, memorySize, accesses, chunkLength, strideLength, ddrChannel);
-         } else {
-            cycles = controller->runDramRandomReadBenchmark((uint64_t) baseAddr, memorySize, accesses, chunkLength, strideLength, ddrChannel);
-         }
+      for (uint64_t stride = chunk; stride <= maxChunkLength; stride *= 2) {
+         runPoint(controller, baseAddr, memorySize, accesses, chunk, stride, clockPeriod, isWrite, useDDR, ddrChannel);
+         points++;
       }
    }
-
-   std::cout << "Execution cycles: " << cycles << std::endl;
-   uint64_t transferSize = ((uint64_t) accesses) * ((uint64_t) chunkLength);
-   double transferSizeGB  = ((double) transferSize) / 1024.0 / 1024.0 / 1024.0;
-   double tp  =  transferSizeGB / ((double) (clockPeriod*cycles) / 1000.0 / 1000.0 / 1000.0);
-   std::cout << std::fixed << "Transfer size [GiB]: " << transferSizeGB << std::endl;
-   std::cout << std::fixed << "Throughput[GiB/s]: " << tp << std::endl;
-   std::cout << std::fixed << "#" << memorySize << "\t" << transferSizeGB << "\t" << chunkLength << "\t" << strideLength << "\t" << cycles << "\t" << tp << std::endl;
+   if (sweep) {
+      double sweepS = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - sweepStart).count() / 1000.0;
+      std::cout << "Sweep of " << points << " points took " << sweepS << " s" << std::endl;
+   }
 
 	fpga::Fpga::getController()->printDebugRegs();
    fpga::Fpga::getController()->printDmaStatsRegs();
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+
+#include <fpga/Fpga.h>
+#include <fpga/FpgaController.h>
+
+/*
+ * Measures the cost of the MMIO primitives the driver is built on: 32-bit
+ * AXI-Lite register accesses, 64-bit and 256-bit stores to the bypass TEST
+ * registers, and fences. The bypass BAR is mapped uncached, stores are never
+ * combined, so the line section reports what a full 64-byte line costs in
+ * uncached stores. Writes report ns per operation, reads a latency distribution.
+ */
+
+static const std::string fenceNames[] = {"none", "sfence", "mfence"};
+
+//Runs op iterations times and drains outstanding stores, returns ns per iteration
+static double nsPerOp(uint64_t iterations, const std::function<void(uint64_t)>& op) {
+   auto start = std::chrono::high_resolution_clock::now();
+   for (uint64_t i = 0; i < iterations; ++i) {
+      op(i);
+   }
+   _mm_mfence();
+   auto end = std::chrono::high_resolution_clock::now();
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count() / (double) iterations;
+}
+
+static void printReadLatencies(const std::string& style, std::vector<double>& samples) {
+   std::sort(samples.begin(), samples.end());
+   double min = samples.front();
+   double p50 = samples[samples.size() / 2];
+   double p99 = samples[(samples.size() * 99) / 100];
+   double p999 = samples[(samples.size() * 999) / 1000];
+   double max = samples.back();
+   std::cout << "Read " << style << " latency [ns] min: " << min << ", p50: " << p50 << ", p99: " << p99 << ", p99.9: " << p999 << ", max: " << max << std::endl;
+   std::cout << "#read\t" << style << "\t" << min << "\t" << p50 << "\t" << p99 << "\t" << p999 << "\t" << max << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+
+   //command line arguments
+
+   boost::program_options::options_description programDescription("Allowed options");
+   programDescription.add_options()("iterations,i", boost::program_options::value<uint64_t>(), "Writes per measurement, default: 1M")
+                                    ("samples,s", boost::program_options::value<uint32_t>(), "Timed reads per access style, default: 100k");
+
+   boost::program_options::variables_map commandLineArgs;
+   boost::program_options::store(boost::program_options::parse_command_line(argc, argv, programDescription), commandLineArgs);
+   boost::program_options::notify(commandLineArgs);
+
+   uint64_t iterations = 1000000;
+   uint32_t numberOfSamples = 100000;
+
+   if (commandLineArgs.count("iterations") > 0) {
+      iterations = commandLineArgs["iterations"].as<uint64_t>();
+   }
+   if (commandLineArgs.count("samples") > 0) {
+      numberOfSamples = commandLineArgs["samples"].as<uint32_t>();
+   }
+
+   fpga::Fpga::setNodeId(0);
+   fpga::Fpga::initializeMemory();
+   fpga::FpgaController* controller = fpga::Fpga::getController();
+
+   //Posted writes, optionally fenced after every store
+   std::cout << "------------ POSTED WRITES ---------------" << std::endl;
+   for (uint8_t f = 0; f < 3; ++f) {
+      fpga::mmioFence fence = (fpga::mmioFence) f;
+      double axiNs = controller->runMmioWriteBenchmark(fpga::mmioAccess::AXILITE, fence, iterations);
+      double mmNs = controller->runMmioWriteBenchmark(fpga::mmioAccess::BYPASS_64, fence, iterations);
+      double wideNs = controller->runMmioWriteBenchmark(fpga::mmioAccess::BYPASS_256, fence, iterations);
+      std::cout << "Fence " << fenceNames[f] << " [ns/write] AXI-Lite 32b: " << axiNs << ", bypass 64b: " << mmNs << ", bypass 256b: " << wideNs << std::endl;
+      std::cout << "#write\t" << fenceNames[f] << "\t" << axiNs << "\t" << mmNs << "\t" << wideNs << std::endl;
+   }
+
+   //Round trips, every read is timed on its own
+   std::cout << "------------ READ LATENCY ---------------" << std::endl;
+   std::vector<double> samples(numberOfSamples);
+   controller->runMmioReadBenchmark(fpga::mmioAccess::AXILITE, false, samples);
+   printReadLatencies("AXI-Lite", samples);
+   controller->runMmioReadBenchmark(fpga::mmioAccess::BYPASS_64, false, samples);
+   printReadLatencies("bypass", samples);
+   controller->runMmioReadBenchmark(fpga::mmioAccess::BYPASS_64, true, samples);
+   printReadLatencies("bypass-after-write", samples);
+
+   //Fences without outstanding stores, subtract from the fenced writes above to get the drain cost
+   std::cout << "------------ FENCES ---------------" << std::endl;
+   double sfenceNs = nsPerOp(iterations, [](uint64_t) { _mm_sfence(); });
+   double mfenceNs = nsPerOp(iterations, [](uint64_t) { _mm_mfence(); });
+   std::cout << "Empty fence [ns] sfence: " << sfenceNs << ", mfence: " << mfenceNs << std::endl;
+   std::cout << "#fence\t" << sfenceNs << "\t" << mfenceNs << std::endl;
+
+   //One 64-byte line of uncached stores to distinct addresses, fenced once per line or after every store
+   std::cout << "------------ UNCACHED LINE ---------------" << std::endl;
+   double narrowNs = controller->runMmioLineBenchmark(fpga::mmioAccess::BYPASS_64, false, iterations);
+   double narrowFencedNs = controller->runMmioLineBenchmark(fpga::mmioAccess::BYPASS_64, true, iterations);
+   double wideNs = controller->runMmioLineBenchmark(fpga::mmioAccess::BYPASS_256, false, iterations);
+   double wideFencedNs = controller->runMmioLineBenchmark(fpga::mmioAccess::BYPASS_256, true, iterations);
+   std::cout << "64B line UC [ns] 8x64b: " << narrowNs << ", 8x64b fenced: " << narrowFencedNs;
+   std::cout << ", 2x256b: " << wideNs << ", 2x256b fenced: " << wideFencedNs << std::endl;
+   std::cout << "#uc\t" << narrowNs << "\t" << narrowFencedNs << "\t" << wideNs << "\t" << wideFencedNs << std::endl;
+
+   fpga::Fpga::clear();
+
+   return 0;
+}
@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+#include <random>
+#include <vector>
+#include <limits>
+#include <boost/program_options.hpp>
+
+#include <fpga/Fpga.h>
+#include <fpga/DmaAllocator.h>
+#include <fpga/DmaBuffer.h>
+#include <communication/HardRoceCommunicator.h>
+#include <partition_defs.h>
+
+/*
+ * Partitions tuples on the sender and puts every partition to its offset in
+ * the window of the receiver. With zero copy the partitions are vectors in
+ * DMA memory and are put directly, otherwise they are heap vectors that are
+ * first copied into a DMA staging buffer.
+ */
+
+using namespace std::chrono_literals;
+
+static unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
+
+template <class Allocator>
+void partitionTuples(const std::vector<data::Tuple>& input, std::vector<std::vector<data::Tuple, Allocator>>& partitions) {
+   uint64_t fanout = partitions.size();
+   std::vector<uint64_t> histogram(fanout, 0);
+   for (const data::Tuple& tuple : input) {
+      histogram[tuple.key % fanout]++;
+   }
+   for (uint64_t p = 0; p < fanout; ++p) {
+      partitions[p].clear();
+      partitions[p].reserve(histogram[p]);
+   }
+   for (const data::Tuple& tuple : input) {
+      partitions[tuple.key % fanout].push_back(tuple);
+   }
+}
+
+template <class Allocator>
+void putPartitions(communication::HardRoceCommunicator* communicator, std::vector<std::vector<data::Tuple, Allocator>>& partitions, communication::RoceWin* window) {
+   std::vector<communication::RoceBatchEntry> entries;
+   entries.reserve(partitions.size());
+   uint64_t targetOffset = 0;
+   for (auto& partition : partitions) {
+      uint64_t length = partition.size() * sizeof(data::Tuple);
+      if (length > std::numeric_limits<uint32_t>::max()) {
+         communicator->put(partition.data(), length, 0, 0, targetOffset, window);
+      } else if (length > 0) {
+         entries.push_back({partition.data(), targetOffset, (uint32_t) length, 0});
+      }
+      targetOffset += length;
+   }
+   communicator->putBatch(entries.data(), entries.size(), 0, window);
+}
+
+double elapsedUs(std::chrono::high_resolution_clock::time_point start) {
+   auto end = std::chrono::high_resolution_clock::now();
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count() / 1000.0;
+}
+
+int main(int argc, char *argv[]) {
+
+   //command line arguments
+
+   boost::program_options::options_description programDescription("Allowed options");
+   programDescription.add_options()("tuples,t", boost::program_options::value<uint64_t>(), "Number of tuples, default: 4M")
+                                    ("partitions,p", boost::program_options::value<uint32_t>(), "Number of partitions, default: 64")
+                                    ("repetitions,r", boost::program_options::value<uint32_t>(), "Number of repetitions, default: 5")
+                                    ("zeroCopy,z", boost::program_options::value<bool>(), "Partition into DMA memory, default: true")
+                                    ("address", boost::program_options::value<std::string>(), "master ip address");
+
+   boost::program_options::variables_map commandLineArgs;
+   boost::program_options::store(boost::program_options::parse_command_line(argc, argv, programDescription), commandLineArgs);
+   boost::program_options::notify(commandLineArgs);
+
+   int32_t numberOfNodes = 2;
+   int32_t nodeId = 0;
+   uint64_t numberOfTuples = 4*1024*1024;
+   uint32_t numberOfPartitions = 64;
+   uint32_t numberRepetitions = 5;
+   bool zeroCopy = true;
+   const char* masterAddr = nullptr;
+
+   if (commandLineArgs.count("tuples") > 0) {
+      numberOfTuples = commandLineArgs["tuples"].as<uint64_t>();
+   }
+   if (commandLineArgs.count("partitions") > 0) {
+      numberOfPartitions = commandLineArgs["partitions"].as<uint32_t>();
+   }
+   if (commandLineArgs.count("repetitions") > 0) {
+      numberRepetitions = commandLineArgs["repetitions"].as<uint32_t>();
+   }
+   if (commandLineArgs.count("zeroCopy") > 0) {
+      zeroCopy = commandLineArgs["zeroCopy"].as<bool>();
+   }
+   if (commandLineArgs.count("address") > 0) {
+      nodeId = 1;
+      masterAddr = commandLineArgs["address"].as<std::string>().c_str();
+      std::cout << "master: " << masterAddr << std::endl;
+   }
+
+   fpga::Fpga::setNodeId(nodeId);
+   fpga::Fpga::initializeMemory();
+
+   communication::HardRoceCommunicator* communicator = new communication::HardRoceCommunicator(fpga::Fpga::getController(), nodeId, numberOfNodes, 1, masterAddr);
+
+   //The window holds all tuples, followed by a flag and the value to set it to
+   uint64_t tupleBytes = numberOfTuples * sizeof(data::Tuple);
+   uint64_t windowSize = tupleBytes + 64;
+   uint64_t* dmaBuffer = (uint64_t*) fpga::Fpga::allocate(windowSize);
+   communication::RoceWin* window = (communication::RoceWin*) calloc(1, sizeof(communication::RoceWin));
+   communicator->exchangeWindow(dmaBuffer, windowSize, window);
+   volatile uint64_t* flag = dmaBuffer + (tupleBytes / sizeof(uint64_t));
+   flag[1] = 1;
+
+   if (nodeId == 1) { //sender
+      std::vector<data::Tuple> input(numberOfTuples);
+      std::default_random_engine rand_gen(seed);
+      std::uniform_int_distribution<uint64_t> distr(0, std::numeric_limits<std::uint64_t>::max());
+      for (uint64_t i = 0; i < numberOfTuples; ++i) {
+         input[i].key = distr(rand_gen);
+         input[i].rid = i;
+      }
+
+      std::vector<std::vector<data::Tuple>> heapPartitions(numberOfPartitions);
+      std::vector<std::vector<data::Tuple, fpga::DmaAllocator<data::Tuple>>> dmaPartitions(numberOfPartitions);
+      fpga::DmaBuffer stagingBuffer;
+      if (!zeroCopy) {
+         stagingBuffer = fpga::DmaBuffer(tupleBytes, false);
+      }
+
+      double partitionUs = 0.0;
+      double copyUs = 0.0;
+      double transferUs = 0.0;
+      for (uint32_t r = 0; r < numberRepetitions; ++r) {
+         *flag = 0;
+         auto start = std::chrono::high_resolution_clock::now();
+         if (zeroCopy) {
+            partitionTuples(input, dmaPartitions);
+         } else {
+            partitionTuples(input, heapPartitions);
+         }
+         partitionUs += elapsedUs(start);
+
+         start = std::chrono::high_resolution_clock::now();
+         if (!zeroCopy) {
+            data::Tuple* tPtr = stagingBuffer.as<data::Tuple>();
+            for (auto& partition : heapPartitions) {
+               memcpy(tPtr, partition.data(), partition.size() * sizeof(data::Tuple));
+               tPtr += partition.size();
+            }
+         }
+         copyUs += elapsedUs(start);
+
+         start = std::chrono::high_resolution_clock::now();
+         if (zeroCopy) {
+            putPartitions(communicator, dmaPartitions, window);
+         } else {
+            communicator->put(stagingBuffer, tupleBytes, 0, 0, 0, window);
+         }
+         //set the flag of the receiver, it replies once all tuples arrived
+         communicator->put((void*) &flag[1], sizeof(uint64_t), 0, 0, tupleBytes, window);
+         while (*flag == 0);
+         transferUs += elapsedUs(start);
+
+         std::this_thread::sleep_for(1s);
+      }
+
+      partitionUs /= numberRepetitions;
+      copyUs /= numberRepetitions;
+      transferUs /= numberRepetitions;
+      std::cout << "Zero copy: " << zeroCopy << std::endl;
+      std::cout << "Tuples: " << numberOfTuples << std::endl;
+      std::cout << "Partition[us]: " << partitionUs << std::endl;
+      std::cout << "Copy[us]: " << copyUs << std::endl;
+      std::cout << "Transfer[us]: " << transferUs << std::endl;
+      std::cout << std::fixed << "#" << zeroCopy << "\t" << numberOfTuples << "\t" << partitionUs << "\t" << copyUs << "\t" << transferUs << std::endl;
+
+      communicator->flushLocal();
+      stagingBuffer.release();
+      fpga::DmaBuffer::drain();
+   } else { //receiver
+      for (uint32_t r = 0; r < numberRepetitions; ++r) {
+         //busy polling
+         while (*flag == 0);
+         *flag = 0;
+         //send back
+         communicator->put((void*) &flag[1], sizeof(uint64_t), 0, 1, tupleBytes, window);
+      }
+   }
+
+   fpga::Fpga::getController()->printDmaStatsRegs();
+   fpga::Fpga::printMemoryStats();
+
+   fpga::Fpga::free(dmaBuffer);
+   fpga::Fpga::clear();
+
+   return 0;
+}
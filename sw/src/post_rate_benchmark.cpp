@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <boost/program_options.hpp>
+
+#include <fpga/Fpga.h>
+#include <fpga/CounterSampler.h>
+#include <communication/HardRoceCommunicator.h>
+
+/*
+ * Measures the rate at which several application threads post writes through
+ * one FPGA. The thread count doubles up to the given maximum. The post rate
+ * only covers the submission, the message rate includes the acknowledgement
+ * of the receiver. Every 64th post is timed to show the post latency once the
+ * command fifo is saturated.
+ */
+
+using namespace std::chrono_literals;
+
+int main(int argc, char *argv[]) {
+
+   //command line arguments
+
+   boost::program_options::options_description programDescription("Allowed options");
+   programDescription.add_options()("size,s", boost::program_options::value<uint64_t>(), "Transfer size in bytes, default: 64")
+                                    ("messages,m", boost::program_options::value<uint32_t>(), "Number of messages per thread")
+                                    ("repetitions,r", boost::program_options::value<uint32_t>(), "Number of repetitions")
+                                    ("threads,t", boost::program_options::value<uint32_t>(), "Maximum number of posting threads")
+                                    ("counters", boost::program_options::value<std::string>(), "File the counter rates are written to every second, JSON if it ends in .json")
+                                    ("address", boost::program_options::value<std::string>(), "master ip address");
+
+   boost::program_options::variables_map commandLineArgs;
+   boost::program_options::store(boost::program_options::parse_command_line(argc, argv, programDescription), commandLineArgs);
+   boost::program_options::notify(commandLineArgs);
+
+   int32_t numberOfNodes = 2;
+   int32_t nodeId = 0;
+   uint64_t transferSize = 64;
+   uint32_t numberOfMessages = 100000;
+   uint32_t numberRepetitions = 1;
+   uint32_t maxThreads = 8;
+   const char* masterAddr = nullptr;
+   std::string countersPath;
+
+   if (commandLineArgs.count("size") > 0) {
+      transferSize = commandLineArgs["size"].as<uint64_t>();
+   }
+   if (commandLineArgs.count("messages") > 0) {
+      numberOfMessages = commandLineArgs["messages"].as<uint32_t>();
+   }
+   if (commandLineArgs.count("repetitions") > 0) {
+      numberRepetitions = commandLineArgs["repetitions"].as<uint32_t>();
+   }
+   if (commandLineArgs.count("threads") > 0) {
+      maxThreads = commandLineArgs["threads"].as<uint32_t>();
+   }
+   if (commandLineArgs.count("counters") > 0) {
+      countersPath = commandLineArgs["counters"].as<std::string>();
+   }
+   if (commandLineArgs.count("address") > 0) {
+      nodeId = 1;
+      masterAddr = commandLineArgs["address"].as<std::string>().c_str();
+      std::cout << "master: " << masterAddr << std::endl;
+   }
+
+   fpga::Fpga::setNodeId(nodeId);
+   fpga::Fpga::initializeMemory();
+
+   communication::HardRoceCommunicator* communicator = new communication::HardRoceCommunicator(fpga::Fpga::getController(), nodeId, numberOfNodes, 1, masterAddr);
+
+   //Every thread writes to its own slot, followed by the acknowledgement flag and the value to set it to
+   uint64_t windowSize = transferSize * maxThreads + 64;
+   uint64_t* dmaBuffer = (uint64_t*) fpga::Fpga::allocate(windowSize);
+   communication::RoceWin* window = (communication::RoceWin*) calloc(1, sizeof(communication::RoceWin));
+   communicator->exchangeWindow(dmaBuffer, windowSize, window);
+   volatile uint64_t* flag = dmaBuffer + ((transferSize * maxThreads) / sizeof(uint64_t));
+   flag[0] = 0;
+   flag[1] = 1;
+
+   fpga::CounterSampler* sampler = nullptr;
+   if (!countersPath.empty()) {
+      sampler = new fpga::CounterSampler(fpga::Fpga::getController(), countersPath);
+      sampler->start();
+   }
+
+   for (uint32_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+      if (nodeId == 1) { //sender
+         double totalPostUs = 0.0;
+         double totalUs = 0.0;
+         std::vector<double> latencies;
+         for (uint32_t r = 0; r < numberRepetitions; ++r) {
+            *flag = 0;
+            std::this_thread::sleep_for(1s);
+
+            std::atomic<uint32_t> ready(0);
+            std::atomic<bool> go(false);
+            std::vector<std::thread> threads;
+            std::vector<std::vector<double>> threadLatencies(numThreads);
+            for (uint32_t t = 0; t < numThreads; ++t) {
+               threads.emplace_back([&, t]() {
+                  std::vector<double>& samples = threadLatencies[t];
+                  samples.reserve(numberOfMessages / 64 + 1);
+                  ready++;
+                  while (!go.load(std::memory_order_acquire));
+                  for (uint32_t m = 0; m < numberOfMessages; ++m) {
+                     if ((m % 64) == 0) {
+                        auto postStart = std::chrono::high_resolution_clock::now();
+                        communicator->put(dmaBuffer, transferSize, 0, 0, t * transferSize, window);
+                        auto postEnd = std::chrono::high_resolution_clock::now();
+                        samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(postEnd-postStart).count() / 1000.0);
+                     } else {
+                        communicator->put(dmaBuffer, transferSize, 0, 0, t * transferSize, window);
+                     }
+                  }
+               });
+            }
+            while (ready.load() != numThreads);
+            auto start = std::chrono::high_resolution_clock::now();
+            go.store(true, std::memory_order_release);
+            for (std::thread& thread : threads) {
+               thread.join();
+            }
+            auto posted = std::chrono::high_resolution_clock::now();
+            communicator->flushLocal();
+            while (*flag == 0);
+            auto end = std::chrono::high_resolution_clock::now();
+            totalPostUs += std::chrono::duration_cast<std::chrono::nanoseconds>(posted-start).count() / 1000.0;
+            totalUs += std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count() / 1000.0;
+            for (std::vector<double>& samples : threadLatencies) {
+               latencies.insert(latencies.end(), samples.begin(), samples.end());
+            }
+         }
+
+         double totalMessages = (double) numberOfMessages * numThreads;
+         double postRate = totalMessages / (totalPostUs / numberRepetitions);
+         double messageRate = totalMessages / (totalUs / numberRepetitions);
+
+         std::sort(latencies.begin(), latencies.end());
+         double p50 = latencies[latencies.size() / 2];
+         double p99 = latencies[(latencies.size() * 99) / 100];
+         double max = latencies.back();
+
+         std::cout << "Threads: " << std::dec << numThreads << std::endl;
+         std::cout << "Post rate [Msg/us]: " << postRate << std::endl;
+         std::cout << "Message rate [Msg/us]: " << messageRate << std::endl;
+         std::cout << "Post latency [us] p50: " << p50 << ", p99: " << p99 << ", max: " << max << std::endl;
+         std::cout << "#" << numThreads << "\t" << transferSize << "\t" << postRate << "\t" << messageRate << "\t" << p50 << "\t" << p99 << "\t" << max << std::endl;
+      } else { //receiver
+         for (uint32_t r = 0; r < numberRepetitions; ++r) {
+            communicator->checkWrites(transferSize * numberOfMessages * numThreads);
+            //acknowledge
+            communicator->put((void*) &flag[1], sizeof(uint64_t), 0, 1, transferSize * maxThreads, window);
+         }
+      }
+   }
+
+   delete sampler;
+   fpga::Fpga::getController()->printDmaStatsRegs();
+
+   delete communicator;
+   fpga::Fpga::free(dmaBuffer);
+   fpga::Fpga::clear();
+
+   return 0;
+}
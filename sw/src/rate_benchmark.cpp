@@ -47,7 +47,9 @@ int main(int argc, char *argv[]) {
                                     ("messages,m", boost::program_options::value<uint32_t>(), "Number of messages")
                                     ("address", boost::program_options::value<std::string>(), "master ip address")
                                     ("warmup,w", boost::program_options::value<bool>(), "run warm up")
-                                    ("isWrite", boost::program_options::value<bool>(), "operation");
+                                    ("isWrite", boost::program_options::value<bool>(), "operation")
+                                    ("batch,b", boost::program_options::value<uint32_t>(), "Messages per batch, 0 posts every message on its own")
+                                    ("hugePageAligned", boost::program_options::value<bool>(), "keep buffers within one huge page");
 
 
    boost::program_options::variables_map commandLineArgs;
@@ -62,6 +64,8 @@ int main(int argc, char *argv[]) {
    const char* masterAddr = nullptr;
    bool runWarmUp = true;
    bool isWrite = true;
+   bool hugePageAligned = false;
+   uint32_t batchSize = 0;
 
    if (commandLineArgs.count("size") > 0) {
       transferSize = commandLineArgs["size"].as<uint64_t>();
@@ -82,6 +86,12 @@ int main(int argc, char *argv[]) {
    if (commandLineArgs.count("isWrite") > 0) {
       isWrite = commandLineArgs["isWrite"].as<bool>();
    }
+   if (commandLineArgs.count("hugePageAligned") > 0) {
+      hugePageAligned = commandLineArgs["hugePageAligned"].as<bool>();
+   }
+   if (commandLineArgs.count("batch") > 0) {
+      batchSize = commandLineArgs["batch"].as<uint32_t>();
+   }
 
    std::cout << "tranferSize " << transferSize << std::endl;
    if (isWrite) {
@@ -89,6 +99,9 @@ int main(int argc, char *argv[]) {
    } else {
       std::cout << "Running read benchmark" << std::endl;
    }
+   if (batchSize > 0) {
+      std::cout << "Batches of " << batchSize << " messages" << std::endl;
+   }
 
    if (commandLineArgs.count("address") > 0) {
       nodeId = 1;
@@ -97,6 +110,7 @@ int main(int argc, char *argv[]) {
    }
 
    fpga::Fpga::setNodeId(nodeId);
+   fpga::Fpga::setHugePageAligned(hugePageAligned);
    fpga::Fpga::initializeMemory();
 
    communication::HardRoceCommunicator* communicator = new communication::HardRoceCommunicator(fpga::Fpga::getController(), nodeId, numberOfNodes, 1, masterAddr);
@@ -120,6 +134,8 @@ int main(int argc, char *argv[]) {
       if (!isWrite) {
          communicator->put(dmaBuffer, transferSize, 0, 0, 0, window);
       }
+      std::vector<communication::RoceBatchEntry> entries(numberOfMessages-1, {dmaBuffer, 0, (uint32_t) transferSize, 0});
+
       volatile uint64_t* pollPtr = dmaBuffer;
       if (isWrite) {
          pollPtr += (transferSize/sizeof(uint64_t));
@@ -143,15 +159,27 @@ int main(int argc, char *argv[]) {
          std::this_thread::sleep_for(5s);
          auto start = std::chrono::high_resolution_clock::now();
          if (isWrite) {
-            for (uint32_t m = 0; m < numberOfMessages-1; ++m) {
-               communicator->put(dmaBuffer, transferSize, 0, 0, 0, window);
+            if (batchSize > 0) {
+               for (uint32_t m = 0; m < numberOfMessages-1; m += batchSize) {
+                  communicator->putBatch(&entries[m], std::min(batchSize, numberOfMessages-1-m), 0, window);
+               }
+            } else {
+               for (uint32_t m = 0; m < numberOfMessages-1; ++m) {
+                  communicator->put(dmaBuffer, transferSize, 0, 0, 0, window);
+               }
             }
             //last message triggers other side to reply
             uint64_t targetOffset = transferSize;
             communicator->put(dmaBuffer, transferSize, 0, 0, targetOffset, window);
          } else {
-            for (uint32_t m = 0; m < numberOfMessages-1; ++m) {
-               communicator->get(dmaBuffer, transferSize, 0, 0, 0, window);
+            if (batchSize > 0) {
+               for (uint32_t m = 0; m < numberOfMessages-1; m += batchSize) {
+                  communicator->getBatch(&entries[m], std::min(batchSize, numberOfMessages-1-m), 0, window);
+               }
+            } else {
+               for (uint32_t m = 0; m < numberOfMessages-1; ++m) {
+                  communicator->get(dmaBuffer, transferSize, 0, 0, 0, window);
+               }
             }
             //last message triggers other side to reply
             uint64_t targetOffset = transferSize;
@@ -159,7 +187,11 @@ int main(int argc, char *argv[]) {
 
          }
 
-         while(*pollPtr == 0) {};
+         if (isWrite) {
+            communicator->waitForRemoteWrites(1, pollPtr);
+         } else {
+            communicator->waitForGets(pollPtr);
+         }
          auto end = std::chrono::high_resolution_clock::now();
          durationUs = (std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count() / 1000.0);
 
@@ -180,7 +212,7 @@ int main(int argc, char *argv[]) {
                continue;
             }
             //busy polling
-            while (*pollPtr == 0);
+            communicator->waitForRemoteWrites(numberOfMessages, pollPtr);
             //send back
             communicator->put(dmaBuffer, 8, 0, 1, transferSize, window);
 
@@ -188,7 +220,8 @@ int main(int argc, char *argv[]) {
             memset(dmaBuffer, 0, allocSize);
          }
       } else {
-         while (*pollPtr == 0);
+         //data to read and release
+         communicator->waitForRemoteWrites(2, pollPtr);
       }
    }
 
@@ -229,11 +262,12 @@ int main(int argc, char *argv[]) {
       std::cout << std::fixed << "Message rate [Msg/s]: " << (messageRate * 1000.0 * 1000.0) << std::endl;
       std::cout << "Stddev: " <<stddev << std::endl;
 
-      std::cout << "#" << transferSize << "\t" << messageRate  << "\t" << stddev << std::endl;
+      std::cout << "#" << transferSize << "\t" << messageRate  << "\t" << stddev << "\t" << batchSize << std::endl;
    }
 
 	fpga::Fpga::getController()->printDebugRegs();
    fpga::Fpga::getController()->printDmaStatsRegs();
+   fpga::Fpga::printMemoryStats();
 
    fpga::Fpga::free(dmaBuffer);
    fpga::Fpga::clear();
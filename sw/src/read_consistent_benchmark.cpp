@@ -17,6 +17,7 @@
 #include <algorithm>
 
 #include <fpga/Fpga.h>
+#include <fpga/ScratchArena.h>
 #include <communication/Communicator.h>
 #include <communication/HardRoceCommunicator.h>
 
@@ -284,8 +285,8 @@ int main(int argc, char *argv[]) {
 
       fillRandomData(dmaBuffer, numberOfElements, valueSize);
       volatile uint64_t* pollPtr = dmaBuffer;
-      unsigned char* valuePtr = (unsigned char*) dmaBuffer;
-      valuePtr += dataSize;
+      //Only the polled words are cleared between repetitions
+      fpga::ScratchArena results(dmaBuffer + (dataSize/sizeof(uint64_t)), resultSize);
       uint64_t valueOffset = 0;
 
       //write data to remote node
@@ -294,8 +295,6 @@ int main(int argc, char *argv[]) {
       //read this random data multiple times
       int pkgCounter = 0;
       for (uint32_t r = 0; r < numberRepetitions+1; ++r) {
-         unsigned char* vPtr = valuePtr;
-
          if (r == 0) {
             if (!runWarmup)
                   continue;
@@ -303,7 +302,7 @@ int main(int argc, char *argv[]) {
          } else {
             std::cout << "Repetition: " << r <<  "/" << numberRepetitions << std::endl;
          }
-         memset((void*) (dmaBuffer+(dataSize/sizeof(uint64_t))), 0, resultSize);
+         results.reset();
          requestIndexes.clear();
          requestIndexes.reserve(numberOfRequests);
 
@@ -314,9 +313,11 @@ int main(int argc, char *argv[]) {
             requestIndexes.push_back(randOffset);
             valueOffset = randOffset * valueSize;
 
+            unsigned char* vPtr = (unsigned char*) results.allocate(valueSize, sizeof(uint64_t));
             pollPtr = (uint64_t*) vPtr;
             pollPtr += (valueSize/sizeof(uint64_t));
             pollPtr--;
+            results.mark(pollPtr);
 
             auto start = std::chrono::high_resolution_clock::now();
             if (doCheck) {
@@ -344,7 +345,6 @@ int main(int argc, char *argv[]) {
                while(*pollPtr == 0) {};
             }
             auto end = std::chrono::high_resolution_clock::now();
-            vPtr += valueSize;
             durationUs = (std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count() / 1000.0);
             if (r != 0) {
                durations.push_back(durationUs);
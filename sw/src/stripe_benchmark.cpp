@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2018, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <boost/program_options.hpp>
+
+#include <fpga/Fpga.h>
+#include <communication/StripedCommunicator.h>
+
+/*
+ * Measures the put bandwidth when large messages are striped across all
+ * FPGAs of a node. The receiver waits for the bytes written by all its cards
+ * and acknowledges with a small put.
+ */
+
+using namespace std::chrono_literals;
+
+int main(int argc, char *argv[]) {
+
+   //command line arguments
+
+   boost::program_options::options_description programDescription("Allowed options");
+   programDescription.add_options()("size,s", boost::program_options::value<uint64_t>(), "Transfer size in bytes")
+                                    ("messages,m", boost::program_options::value<uint32_t>(), "Number of messages")
+                                    ("repetitions,r", boost::program_options::value<uint32_t>(), "Number of repetitions")
+                                    ("devices,d", boost::program_options::value<uint32_t>(), "Number of FPGAs, default: 2")
+                                    ("address", boost::program_options::value<std::string>(), "master ip address");
+
+   boost::program_options::variables_map commandLineArgs;
+   boost::program_options::store(boost::program_options::parse_command_line(argc, argv, programDescription), commandLineArgs);
+   boost::program_options::notify(commandLineArgs);
+
+   int32_t numberOfNodes = 2;
+   int32_t nodeId = 0;
+   uint64_t transferSize = 0;
+   uint32_t numberOfMessages = 10;
+   uint32_t numberRepetitions = 1;
+   uint32_t numberOfDevices = 2;
+   const char* masterAddr = nullptr;
+
+   if (commandLineArgs.count("size") > 0) {
+      transferSize = commandLineArgs["size"].as<uint64_t>();
+   } else {
+      std::cerr << "argument missing";
+      return 1;
+   }
+   if (commandLineArgs.count("messages") > 0) {
+      numberOfMessages = commandLineArgs["messages"].as<uint32_t>();
+   }
+   if (commandLineArgs.count("repetitions") > 0) {
+      numberRepetitions = commandLineArgs["repetitions"].as<uint32_t>();
+   }
+   if (commandLineArgs.count("devices") > 0) {
+      numberOfDevices = commandLineArgs["devices"].as<uint32_t>();
+   }
+   if (commandLineArgs.count("address") > 0) {
+      nodeId = 1;
+      masterAddr = commandLineArgs["address"].as<std::string>().c_str();
+      std::cout << "master: " << masterAddr << std::endl;
+   }
+
+   fpga::Fpga::setNodeId(nodeId);
+   fpga::Fpga::setNumberOfDevices(numberOfDevices);
+   fpga::Fpga::initializeMemory();
+
+   communication::StripedCommunicator* communicator = new communication::StripedCommunicator(nodeId, numberOfNodes, 1, masterAddr);
+
+   //The window holds one message, followed by the acknowledgement flag and the value to set it to
+   uint64_t windowSize = transferSize + 64;
+   uint64_t* dmaBuffer = (uint64_t*) fpga::Fpga::allocate(windowSize);
+   communication::RoceWin* window = (communication::RoceWin*) calloc(1, sizeof(communication::RoceWin));
+   communicator->exchangeWindow(dmaBuffer, windowSize, window);
+   volatile uint64_t* flag = dmaBuffer + (transferSize / sizeof(uint64_t));
+   flag[0] = 0;
+   flag[1] = 1;
+
+   if (nodeId == 1) { //sender
+      std::vector<double> durations;
+      for (uint32_t r = 0; r < numberRepetitions; ++r) {
+         *flag = 0;
+         std::this_thread::sleep_for(1s);
+         auto start = std::chrono::high_resolution_clock::now();
+         for (uint32_t m = 0; m < numberOfMessages; ++m) {
+            communicator->put(dmaBuffer, transferSize, 0, 0, 0, window);
+         }
+         communicator->flushLocal();
+         while (*flag == 0);
+         auto end = std::chrono::high_resolution_clock::now();
+         durations.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end-start).count() / 1000.0);
+      }
+
+      double totalDurationUs = 0.0;
+      for (double duration : durations) {
+         totalDurationUs += duration;
+      }
+      double avgDurationUs = totalDurationUs / (double) numberRepetitions;
+      double bandwidth = ((double) transferSize * numberOfMessages * 8.0) / (avgDurationUs * 1000.0);
+
+      std::cout << "Size[B]: " << std::dec << transferSize << std::endl;
+      std::cout << "Messages: " << numberOfMessages << std::endl;
+      std::cout << "Devices: " << communicator->getNumberOfDevices() << std::endl;
+      std::cout << "Duration[us]: " << avgDurationUs << std::endl;
+      std::cout << "Bandwidth[Gbit/s]: " << bandwidth << std::endl;
+      std::cout << "#" << transferSize << "\t" << communicator->getNumberOfDevices() << "\t" << bandwidth << std::endl;
+   } else { //receiver
+      for (uint32_t r = 0; r < numberRepetitions; ++r) {
+         communicator->checkWrites(transferSize * numberOfMessages);
+         //acknowledge
+         communicator->put((void*) &flag[1], sizeof(uint64_t), 0, 1, transferSize, window);
+      }
+   }
+
+   for (uint32_t d = 0; d < fpga::Fpga::getNumberOfDevices(); ++d) {
+      fpga::Fpga::getController(d)->printDmaStatsRegs();
+   }
+
+   delete communicator;
+   fpga::Fpga::free(dmaBuffer);
+   fpga::Fpga::clear();
+
+   return 0;
+}